@@ -6,13 +6,28 @@
 #include "Guild.hpp"
 #include "utils.hpp"
 #include "Embed.hpp"
+#include "JsonWriter.hpp"
+#include "misc.hpp"
 
 #include "fmt/format.h"
+#include <boost/spirit/include/qi_uint.hpp>
 
 
 #undef SendMessage // Windows at its finest
 
 
+namespace
+{
+	// permissions are 64-bit integers sent as strings, anything else is rejected
+	bool ParsePermissions(std::string const &str, unsigned long long int &dest)
+	{
+		auto it = str.begin();
+		return qi::parse(it, str.end(), qi::uint_parser<unsigned long long int>(), dest)
+			&& it == str.end();
+	}
+}
+
+
 Channel::Channel(ChannelId_t pawn_id, json const &data, GuildId_t guild_id) :
 	m_PawnId(pawn_id)
 {
@@ -60,15 +75,53 @@ Channel::Channel(ChannelId_t pawn_id, Snowflake_t channel_id, Type type) :
 
 void Channel::Update(json const &data)
 {
+	std::string const old_name = m_Name;
+
 	utils::TryGetJsonValue(data, m_Name, "name"),
 	utils::TryGetJsonValue(data, m_Topic, "topic"),
 	utils::TryGetJsonValue(data, m_Position, "position"),
 	utils::TryGetJsonValue(data, m_IsNsfw, "nsfw");
+
+	if (utils::IsValidJson(data, "permission_overwrites", json::value_t::array))
+	{
+		// a partial list could grant more than the channel allows, so the
+		// overwrites are only replaced if every entry is valid
+		decltype(m_PermissionOverwrites) overwrites;
+		bool valid = true;
+		for (auto const &o : data["permission_overwrites"])
+		{
+			PermissionOverwrite overwrite;
+			unsigned int type;
+			std::string allow, deny;
+			if (!utils::TryGetJsonValue(o, overwrite.Id, "id")
+				|| !utils::TryGetJsonValue(o, type, "type")
+				|| !utils::TryGetJsonValue(o, allow, "allow")
+				|| !utils::TryGetJsonValue(o, deny, "deny")
+				|| !overwrite.Id.IsValid()
+				|| !ParsePermissions(allow, overwrite.Allow)
+				|| !ParsePermissions(deny, overwrite.Deny))
+			{
+				Logger::Get()->Log(samplog_LogLevel::ERROR,
+					"can't update permission overwrites of channel '{}': invalid overwrite \"{}\"",
+					m_Id, o.dump());
+				valid = false;
+				break;
+			}
+
+			overwrite.IsMember = type == 1; // 0 is role
+			overwrites.push_back(overwrite);
+		}
+
+		if (valid)
+			m_PermissionOverwrites = std::move(overwrites);
+	}
+
+	ChannelManager::Get()->UpdateChannelName(m_PawnId, old_name, m_Name);
 }
 
 void Channel::UpdateParentChannel(Snowflake_t const &parent_id)
 {
-	if (parent_id.length() < 1)
+	if (!parent_id.IsValid())
 	{
 		m_ParentId = 0;
 		return;
@@ -86,13 +139,11 @@ void Channel::UpdateParentChannel(Snowflake_t const &parent_id)
 
 void Channel::SendMessage(std::string &&msg, pawn_cb::Callback_t &&cb)
 {
-	json data = {
-		{ "content", std::move(msg) }
-	};
-
-	std::string json_str;
-	if (!utils::TryDumpJson(data, json_str))
-		Logger::Get()->Log(samplog_LogLevel::ERROR, "can't serialize JSON: {}", json_str);
+	auto &json_str = JsonWriter::ThreadBuffer();
+	JsonWriter(json_str)
+		.BeginObject()
+		.String("content", msg)
+		.EndObject();
 
 	Http::ResponseCb_t response_cb;
 	if (cb)
@@ -102,12 +153,13 @@ void Channel::SendMessage(std::string &&msg, pawn_cb::Callback_t &&cb)
 			Logger::Get()->Log(samplog_LogLevel::DEBUG,
 				"channel message create response: status {}; body: {}; add: {}",
 				response.status, response.body, response.additional_data);
-			if (response.status / 100 == 2) // success
+			gateway::Message msg_data;
+			if (response.status / 100 == 2 // success
+				&& gateway::DecodeMessage(response.body, msg_data))
 			{
-				auto msg_json = json::parse(response.body);
-				PawnDispatcher::Get()->Dispatch([cb, msg_json]() mutable
+				PawnDispatcher::Get()->Dispatch([cb, msg_data = std::move(msg_data)]() mutable
 				{
-					auto msg = MessageManager::Get()->Create(msg_json);
+					auto msg = MessageManager::Get()->Create(msg_data);
 					if (msg != INVALID_MESSAGE_ID)
 					{
 						MessageManager::Get()->SetCreatedMessageId(msg);
@@ -202,53 +254,14 @@ void Channel::DeleteChannel()
 
 void Channel::SendEmbeddedMessage(const Embed_t & embed, std::string&& msg, pawn_cb::Callback_t&& cb)
 {
-	json data = {
-		{ "content", std::move(msg) },
-		{ "embeds", { json::object() } }
-	};
-
-	data["embeds"][0] = json::object({
-		{ "title", embed->GetTitle() },
-		{ "description", embed->GetDescription() },
-		{ "url", embed->GetUrl() },
-		{ "timestamp", embed->GetTimestamp() },
-		{ "color", embed->GetColor() },
-		{ "footer", {
-			{"text", embed->GetFooterText()},
-			{"icon_url", embed->GetFooterIconUrl()},
-		} },
-		{ "thumbnail", json::object() },
-		{ "image", json::object() }
-	});
-
-	if (!embed->GetThumbnailUrl().empty())
-	{
-		data["embeds"][0]["thumbnail"]["url"] = embed->GetThumbnailUrl();
-	}
-
-	if (!embed->GetImageUrl().empty())
-	{
-		data["embeds"][0]["image"]["url"] = embed->GetImageUrl();
-	}
-
-	// Add fields (if any).
-	if (embed->GetFields().size())
-	{
-		json field_array = json::array();
-		for (const auto& i : embed->GetFields())
-		{
-			field_array.push_back({
-				{"name", i._name},
-				{"value", i._value},
-				{"inline", i._inline_}
-			});
-		}
-		data["embeds"][0]["fields"] = field_array;
-	}
-
-	std::string json_str;
-	if (!utils::TryDumpJson(data, json_str))
-		Logger::Get()->Log(samplog_LogLevel::ERROR, "can't serialize JSON: {}", json_str);
+	auto &json_str = JsonWriter::ThreadBuffer();
+	JsonWriter writer(json_str);
+	writer.BeginObject()
+		.String("content", msg)
+		.BeginArray("embeds");
+	embed->Serialize(writer);
+	writer.EndArray()
+		.EndObject();
 
 	Http::ResponseCb_t response_cb;
 	if (cb)
@@ -258,12 +271,13 @@ void Channel::SendEmbeddedMessage(const Embed_t & embed, std::string&& msg, pawn
 			Logger::Get()->Log(samplog_LogLevel::DEBUG,
 				"channel message create response: status {}; body: {}; add: {}",
 				response.status, response.body, response.additional_data);
-			if (response.status / 100 == 2) // success
+			gateway::Message msg_data;
+			if (response.status / 100 == 2 // success
+				&& gateway::DecodeMessage(response.body, msg_data))
 			{
-				auto msg_json = json::parse(response.body);
-				PawnDispatcher::Get()->Dispatch([cb, msg_json]() mutable
+				PawnDispatcher::Get()->Dispatch([cb, msg_data = std::move(msg_data)]() mutable
 					{
-						auto msg = MessageManager::Get()->Create(msg_json);
+						auto msg = MessageManager::Get()->Create(msg_data);
 						if (msg != INVALID_MESSAGE_ID)
 						{
 							MessageManager::Get()->SetCreatedMessageId(msg);
@@ -287,9 +301,9 @@ void ChannelManager::Initialize()
 {
 	assert(m_Initialized != m_InitValue);
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::CHANNEL_CREATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::CHANNEL_CREATE, [](json &&data)
 	{
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			auto const channel_id = ChannelManager::Get()->AddChannel(data);
 			if (channel_id == INVALID_CHANNEL_ID)
@@ -301,9 +315,9 @@ void ChannelManager::Initialize()
 		});
 	});
 	
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::CHANNEL_UPDATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::CHANNEL_UPDATE, [](json &&data)
 	{
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			Snowflake_t sfid;
 			if (!utils::TryGetJsonValue(data, sfid, "id"))
@@ -322,6 +336,11 @@ void ChannelManager::Initialize()
 			}
 
 			channel->Update(data);
+
+			Guild_t const &guild = GuildManager::Get()->FindGuild(channel->GetGuildId());
+			if (guild)
+				guild->InvalidateMemberPermissions();
+
 			if (channel->GetType() != Channel::Type::GUILD_CATEGORY)
 			{
 				Snowflake_t parent_id;
@@ -418,16 +437,17 @@ ChannelId_t ChannelManager::AddChannel(json const &data, GuildId_t guild_id/* =
 	if (channel)
 		return channel->GetPawnId(); // channel already exists
 
-	ChannelId_t id = 1;
-	while (m_Channels.find(id) != m_Channels.end())
-		++id;
-
-	if (!m_Channels.emplace(id, Channel_t(new Channel(id, data, guild_id))).second)
+	ChannelId_t id = m_Channels.Emplace([&](void *storage, ChannelId_t pawn_id)
+	{
+		return new (storage) Channel(pawn_id, data, guild_id);
+	});
+	if (id == INVALID_CHANNEL_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create channel: duplicate key '{}'", id);
+			"can't create channel: out of channel ids");
 		return INVALID_CHANNEL_ID;
 	}
+	m_ChannelIds.emplace(sfid, id);
 
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully added channel with id '{}'", id);
 	return id;
@@ -443,20 +463,26 @@ ChannelId_t ChannelManager::AddDMChannel(json const& data)
 		return INVALID_CHANNEL_ID;
 	}
 
+	return AddDMChannel(sfid);
+}
+
+ChannelId_t ChannelManager::AddDMChannel(Snowflake_t const &sfid)
+{
 	Channel_t const& channel = FindChannelById(sfid);
 	if (channel)
 		return channel->GetPawnId(); // channel already exists
 
-	ChannelId_t id = 1;
-	while (m_Channels.find(id) != m_Channels.end())
-		++id;
-
-	if (!m_Channels.emplace(id, Channel_t(new Channel(id, sfid, Channel::Type::DM))).second)
+	ChannelId_t id = m_Channels.Emplace([&](void *storage, ChannelId_t pawn_id)
+	{
+		return new (storage) Channel(pawn_id, sfid, Channel::Type::DM);
+	});
+	if (id == INVALID_CHANNEL_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create channel: duplicate key '{}'", id);
+			"can't create channel: out of channel ids");
 		return INVALID_CHANNEL_ID;
 	}
+	m_ChannelIds.emplace(sfid, id);
 
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully added channel with id '{}'", id);
 	return id;
@@ -490,40 +516,35 @@ void ChannelManager::DeleteChannel(json const &data)
 		if (guild)
 			guild->RemoveChannel(channel->GetPawnId());
 
-		m_Channels.erase(channel->GetPawnId());
+		ChannelId_t const id = channel->GetPawnId();
+		m_ChannelNames.Remove(channel->GetName(), id);
+		m_ChannelIds.erase(sfid);
+		m_Channels.Erase(id);
 	});
 
 }
 
 Channel_t const &ChannelManager::FindChannel(ChannelId_t id)
 {
-	static Channel_t invalid_channel;
-	auto it = m_Channels.find(id);
-	if (it == m_Channels.end())
-		return invalid_channel;
-	return it->second;
+	return m_Channels.Find(id);
 }
 
-Channel_t const &ChannelManager::FindChannelByName(std::string const &name)
+void ChannelManager::UpdateChannelName(ChannelId_t id,
+	std::string const &old_name, std::string const &new_name)
 {
-	static Channel_t invalid_channel;
-	for (auto const &c : m_Channels)
-	{
-		Channel_t const &channel = c.second;
-		if (channel->GetName().compare(name) == 0)
-			return channel;
-	}
-	return invalid_channel;
+	m_ChannelNames.Rename(old_name, new_name, id);
+}
+
+Channel_t const &ChannelManager::FindChannelByName(std::string const &name, bool case_sensitive)
+{
+	return FindChannel(m_ChannelNames.Find(name, case_sensitive));
 }
 
 Channel_t const &ChannelManager::FindChannelById(Snowflake_t const &sfid)
 {
 	static Channel_t invalid_channel;
-	for (auto const &c : m_Channels)
-	{
-		Channel_t const &channel = c.second;
-		if (channel->GetId().compare(sfid) == 0)
-			return channel;
-	}
-	return invalid_channel;
+	auto it = m_ChannelIds.find(sfid);
+	if (it == m_ChannelIds.end())
+		return invalid_channel;
+	return FindChannel(it->second);
 }
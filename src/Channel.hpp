@@ -2,10 +2,14 @@
 
 #include "Singleton.hpp"
 #include "types.hpp"
+#include "SlotMap.hpp"
+#include "NameIndex.hpp"
 #include "Callback.hpp"
 
 #include <string>
 #include <atomic>
+#include <vector>
+#include <unordered_map>
 
 #include <json.hpp>
 
@@ -30,6 +34,15 @@ public:
 		GUILD_STORE = 6
 	};
 
+	struct PermissionOverwrite
+	{
+		Snowflake_t Id; // role or user
+		bool IsMember = false;
+		unsigned long long int
+			Allow = 0,
+			Deny = 0;
+	};
+
 public:
 	Channel(ChannelId_t pawn_id, json const &data, GuildId_t guild_id);
 	Channel(ChannelId_t pawn_id, Snowflake_t channel_id, Type type);
@@ -53,6 +66,8 @@ private:
 
 	ChannelId_t m_ParentId = INVALID_CHANNEL_ID;
 
+	std::vector<PermissionOverwrite> m_PermissionOverwrites;
+
 public:
 	inline ChannelId_t GetPawnId() const
 	{
@@ -90,6 +105,10 @@ public:
 	{
 		return m_ParentId;
 	}
+	inline decltype(m_PermissionOverwrites) const &GetPermissionOverwrites() const
+	{
+		return m_PermissionOverwrites;
+	}
 
 	void SendMessage(std::string &&msg, pawn_cb::Callback_t &&cb);
 	void SendEmbeddedMessage(const Embed_t & embed, std::string&& msg, pawn_cb::Callback_t&& cb);
@@ -115,7 +134,9 @@ private:
 	const unsigned int m_InitValue = 1;
 	std::atomic<unsigned int> m_Initialized{ 0 };
 
-	std::map<ChannelId_t, Channel_t> m_Channels; //PAWN channel-id to actual channel map
+	SlotMap<ChannelId_t, Channel> m_Channels; //PAWN channel-id to actual channel map
+	std::unordered_map<Snowflake_t, ChannelId_t> m_ChannelIds; //snowflake to PAWN channel-id
+	NameIndex<ChannelId_t> m_ChannelNames;
 	ChannelId_t m_CreatedChannelId = INVALID_CHANNEL_ID;
 
 public:
@@ -131,10 +152,14 @@ public:
 
 	ChannelId_t AddChannel(json const &data, GuildId_t guild_id = 0);
 	ChannelId_t AddDMChannel(json const & data);
+	ChannelId_t AddDMChannel(Snowflake_t const &channel_id);
 
 	void DeleteChannel(json const &data);
+	// keeps the name index in sync, called by the channel itself
+	void UpdateChannelName(ChannelId_t id,
+		std::string const &old_name, std::string const &new_name);
 
 	Channel_t const &FindChannel(ChannelId_t id);
-	Channel_t const &FindChannelByName(std::string const &name);
+	Channel_t const &FindChannelByName(std::string const &name, bool case_sensitive = true);
 	Channel_t const &FindChannelById(Snowflake_t const &sfid);
 };
@@ -199,7 +199,7 @@ void CommandManager::Initialize()
 		}, false);
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::INTERACTION_CREATE, [this](const json& data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::INTERACTION_CREATE, [this](json &&data)
 	{
 		if (data.find("type") != data.end() && data.at("type").get<int>() == 2 /*application command*/)
 		{
@@ -228,7 +228,7 @@ void CommandManager::Initialize()
 			}
 			
 			auto interactionid = CommandInteractionManager::Get()->AddCommandInteraction(userid, data);
-			PawnDispatcher::Get()->Dispatch([userid, interactionid, data]() mutable
+			PawnDispatcher::Get()->Dispatch([userid, interactionid, data = std::move(data)]() mutable
 			{
 				auto & interaction = CommandInteractionManager::Get()->FindCommandInteraction(interactionid);
 				auto & command = CommandManager::Get()->FindCommand(CommandManager::Get()->FindCommandIdByName(data.at("data").at("name").get<std::string>(), interaction->GetGuildID()));
@@ -293,9 +293,7 @@ void CommandManager::ParseCommandCreationData(nlohmann::json& command_json, Guil
 
 Command_t & CommandManager::AddCommandInternal(Snowflake_t const& snowflake, std::string const& name, std::string const& description, GuildId_t guild)
 {
-	CommandId_t id = 1;
-	while (m_Commands.find(id) != m_Commands.end())
-		++id;
+	CommandId_t id = m_IdAllocator.Allocate();
 	static Command_t invalid_command;
 	if (!m_Commands.emplace(id, Command_t(new Command(snowflake, name, description, guild))).first->second)
 	{
@@ -310,9 +308,7 @@ Command_t & CommandManager::AddCommandInternal(Snowflake_t const& snowflake, std
 
 CommandId_t CommandManager::AddCommand(std::string const& name, std::string const & description)
 {
-	CommandId_t id = 1;
-	while (m_Commands.find(id) != m_Commands.end())
-		++id;
+	CommandId_t id = m_IdAllocator.Allocate();
 
 	if (!m_Commands.emplace(id, Command_t(new Command("", name, description, INVALID_GUILD_ID))).first->second)
 	{
@@ -334,6 +330,7 @@ bool CommandManager::DeleteCommand(CommandId_t id)
 	}
 
 	m_Commands.erase(id);
+	m_IdAllocator.Free(id);
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully deleted command with id '{}'", id);
 	return true;
 }
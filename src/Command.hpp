@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.hpp"
+#include "IdAllocator.hpp"
 #include "Singleton.hpp"
 #include "PawnDispatcher.hpp"
 #include "Callback.hpp"
@@ -158,6 +159,7 @@ private:
 
 private:
 	std::map<CommandId_t, Command_t> m_Commands;
+	IdAllocator<CommandId_t> m_IdAllocator;
 	const unsigned int m_InitValue = 1;
 	std::atomic<unsigned int> m_Initialized{ 0 };
 	unsigned int m_InitGuilds = 0;
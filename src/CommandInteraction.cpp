@@ -202,9 +202,7 @@ CommandInteraction_t const & CommandInteractionManager::FindCommandInteraction(C
 
 CommandInteractionId_t CommandInteractionManager::AddCommandInteraction(UserId_t user, nlohmann::json const& interaction_json)
 {
-	CommandInteractionId_t id = 1;
-	while (m_Interactions.find(id) != m_Interactions.end())
-		++id;
+	CommandInteractionId_t id = m_IdAllocator.Allocate();
 
 	if (!m_Interactions.emplace(id, CommandInteraction_t(new CommandInteraction(id, user, interaction_json))).first->second)
 	{
@@ -226,6 +224,7 @@ bool CommandInteractionManager::DeleteCommandInteraction(CommandInteractionId_t
 	}
 
 	m_Interactions.erase(interaction);
+	m_IdAllocator.Free(interaction);
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully deleted command interaction with id '{}'", interaction);
 	return true;
 }
\ No newline at end of file
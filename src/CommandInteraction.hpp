@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.hpp"
+#include "IdAllocator.hpp"
 #include "Singleton.hpp"
 #include "PawnDispatcher.hpp"
 #include "Callback.hpp"
@@ -61,7 +62,7 @@ public:
 private:
 	CommandInteractionId_t m_ID;
 	Snowflake_t m_IDSnowflake;
-	Snowflake_t m_Token;
+	std::string m_Token;
 	ChannelId_t m_Channel;
 	GuildId_t m_Guild = 0;
 	UserId_t m_InteractionUser;
@@ -78,6 +79,7 @@ private:
 
 private:
 	std::map<CommandInteractionId_t, CommandInteraction_t> m_Interactions;
+	IdAllocator<CommandInteractionId_t> m_IdAllocator;
 public:
 	CommandInteraction_t const& FindCommandInteraction(CommandInteractionId_t interaction);
 	CommandInteractionId_t AddCommandInteraction(UserId_t user, nlohmann::json const& interaction_json);
@@ -1,4 +1,5 @@
 #include "Embed.hpp"
+#include "JsonWriter.hpp"
 #include "Network.hpp"
 #include "PawnDispatcher.hpp"
 #include "Callback.hpp"
@@ -21,19 +22,60 @@ Embed::Embed(std::string const& title, std::string const& description, std::stri
 {
 }
 
+void Embed::Serialize(JsonWriter &writer)
+{
+	writer.BeginObject()
+		.String("title", _title)
+		.String("description", _description)
+		.String("url", _url)
+		.String("timestamp", _timestamp)
+		.Int("color", _color);
+
+	writer.BeginObject("footer")
+		.String("text", _footer_text);
+	if (!_footer_icon_url.empty())
+		writer.String("icon_url", _footer_icon_url);
+	writer.EndObject();
+
+	writer.BeginObject("thumbnail");
+	if (!_thumbnail_url.empty())
+		writer.String("url", _thumbnail_url);
+	writer.EndObject();
+
+	writer.BeginObject("image");
+	if (!_image_url.empty())
+		writer.String("url", _image_url);
+	writer.EndObject();
+
+	if (!_fields.empty())
+	{
+		writer.BeginArray("fields");
+		for (auto const &field : _fields)
+		{
+			writer.BeginObject()
+				.String("name", field._name)
+				.String("value", field._value)
+				.Bool("inline", field._inline_)
+				.EndObject();
+		}
+		writer.EndArray();
+	}
+	writer.EndObject();
+}
+
 EmbedId_t EmbedManager::AddEmbed(std::string const& title, std::string const& description, std::string const& url, std::string const& timestamp, int color, std::string const& footer_text, std::string const& footer_icon_url,
 	std::string const& thumbnail_url, std::string const& image_url)
 {
-	UserId_t id = 1;
-	while (m_Embeds.find(id) != m_Embeds.end())
-		++id;
-
-	if (!m_Embeds.emplace(id, Embed_t(new Embed(title, description, url, timestamp, footer_text, footer_icon_url, thumbnail_url, image_url,
-		color))).first->second)
+	EmbedId_t id = m_Embeds.Emplace([&](void *storage, EmbedId_t)
+	{
+		return new (storage) Embed(title, description, url, timestamp, footer_text, footer_icon_url, thumbnail_url, image_url,
+			color);
+	});
+	if (id == INVALID_EMBED_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create embed: duplicate key '{}'", id);
-		return INVALID_USER_ID;
+			"can't create embed: out of embed ids");
+		return INVALID_EMBED_ID;
 	}
 
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully created embed with id '{}'", id);
@@ -42,22 +84,17 @@ EmbedId_t EmbedManager::AddEmbed(std::string const& title, std::string const& de
 
 bool EmbedManager::DeleteEmbed(EmbedId_t id)
 {
-	if (m_Embeds.find(id) == m_Embeds.end())
+	if (!m_Embeds.Erase(id))
 	{
 		Logger::Get()->Log(samplog_LogLevel::WARNING, "attempted to delete embed with id '{}' but it does not exist", id);
 		return false;
 	}
 
-	m_Embeds.erase(id);
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully deleted embed with id '{}'", id);
 	return true;
 }
 
 Embed_t const & EmbedManager::FindEmbed(EmbedId_t id)
 {
-	static Embed_t invalid_embed;
-	auto it = m_Embeds.find(id);
-	if (it == m_Embeds.end())
-		return invalid_embed;
-	return it->second;
+	return m_Embeds.Find(id);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Singleton.hpp"
 #include "types.hpp"
+#include "SlotMap.hpp"
 
 #include <string>
 #include <atomic>
@@ -10,6 +11,8 @@
 
 using json = nlohmann::json;
 
+class JsonWriter;
+
 struct EmbedField
 {
 	EmbedField(std::string const& name, std::string const& value, bool inline_ = false) :
@@ -122,6 +125,9 @@ public:
 	{
 		return _fields;
 	}
+
+	// writes the embed object (without key) into a payload
+	void Serialize(JsonWriter &writer);
 private:
 	std::string _title, _description, _url, _timestamp, _footer_text, _footer_icon_url, _thumbnail_url, _image_url;
 	int _color;
@@ -139,7 +145,7 @@ private:
 private:
 	const unsigned int m_InitValue = 1;
 	std::atomic<unsigned int> m_Initialized{ 0 };
-	std::map<EmbedId_t, Embed_t> m_Embeds;
+	SlotMap<EmbedId_t, Embed> m_Embeds;
 public:
 	EmbedId_t AddEmbed(std::string const & title, std::string const & description, std::string const & url, std::string const& timestamp, int color, std::string const & footer_text, std::string const & footer_icon_url,
 		std::string const & thumbnail_url, std::string const & image_url);
@@ -14,15 +14,15 @@ Emoji::Emoji(Snowflake_t const& id, std::string const& name) :
 
 EmojiId_t EmojiManager::AddEmoji(Snowflake_t const & snowflake, std::string const & name)
 {
-	EmojiId_t id = 1;
-	while (m_Emojis.find(id) != m_Emojis.end())
-		++id;
-
-	if (!m_Emojis.emplace(id, Emoji_t(new Emoji(snowflake, name))).first->second)
+	EmojiId_t id = m_Emojis.Emplace([&](void *storage, EmojiId_t)
+	{
+		return new (storage) Emoji(snowflake, name);
+	});
+	if (id == INVALID_EMOJI_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create embed: duplicate key '{}'", id);
-		return INVALID_USER_ID;
+			"can't create emoji: out of emoji ids");
+		return INVALID_EMOJI_ID;
 	}
 
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully created emoji with id '{}'", id);
@@ -31,22 +31,17 @@ EmojiId_t EmojiManager::AddEmoji(Snowflake_t const & snowflake, std::string cons
 
 bool EmojiManager::DeleteEmoji(EmojiId_t id)
 {
-	if (m_Emojis.find(id) == m_Emojis.end())
+	if (!m_Emojis.Erase(id))
 	{
 		Logger::Get()->Log(samplog_LogLevel::WARNING, "attempted to delete emoji with id '{}' but it does not exist", id);
 		return false;
 	}
 
-	m_Emojis.erase(id);
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully deleted emoji with id '{}'", id);
 	return true;
 }
 
 Emoji_t const& EmojiManager::FindEmoji(EmojiId_t id)
 {
-	static Emoji_t invalid_embed;
-	auto it = m_Emojis.find(id);
-	if (it == m_Emojis.end())
-		return invalid_embed;
-	return it->second;
+	return m_Emojis.Find(id);
 }
\ No newline at end of file
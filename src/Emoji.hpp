@@ -2,6 +2,7 @@
 
 #include "Singleton.hpp"
 #include "types.hpp"
+#include "SlotMap.hpp"
 
 #include <string>
 #include <atomic>
@@ -38,7 +39,7 @@ private:
 	~EmojiManager() = default;
 
 private:
-	std::map<EmojiId_t, Emoji_t> m_Emojis;
+	SlotMap<EmojiId_t, Emoji> m_Emojis;
 public:
 	EmojiId_t AddEmoji(Snowflake_t const & snowflake, std::string const & name);
 	bool DeleteEmoji(EmojiId_t id);
@@ -0,0 +1,457 @@
+#include "GatewayEvents.hpp"
+
+#include <array>
+#include <json.hpp>
+
+
+using json = nlohmann::json;
+
+namespace
+{
+	// Walks a payload with the SAX interface of the JSON library and hands
+	// the values of the fields we're interested in to the event decoder.
+	// Fields are identified by nodes, which the decoders map from the parent
+	// node and the key; values of unmapped fields (SKIP) and everything nested
+	// in them are passed over without being stored anywhere.
+	class SaxDecoder : public json::json_sax_t
+	{
+	public:
+		// the node of the event data, decoders start their own nodes after it
+		static const int
+			SKIP = -1,
+			ROOT = 0,
+			DATA = 1;
+
+		explicit SaxDecoder(bool envelope) :
+			m_Next(envelope ? ROOT : DATA)
+		{ }
+		virtual ~SaxDecoder() = default;
+
+		bool Parse(const char *data, size_t length)
+		{
+			return json::sax_parse(data, data + length, this);
+		}
+
+	protected:
+		// node of member "key" of the object "parent"
+		virtual int GetMemberNode(int parent, std::string const &key) = 0;
+		// node of the elements of the array "parent"
+		virtual int GetElementNode(int parent)
+		{
+			(void)parent; // unused
+			return SKIP;
+		}
+
+		virtual void OnString(int node, std::string const &value)
+		{
+			(void)node; (void)value; // unused
+		}
+		virtual void OnBool(int node, bool value)
+		{
+			(void)node; (void)value; // unused
+		}
+		virtual void OnNull(int node)
+		{
+			(void)node; // unused
+		}
+
+	private:
+		struct Scope
+		{
+			int Node;
+			bool IsArray;
+		};
+		// the fields we decode are only a few levels deep, nesting beyond
+		// that is only counted
+		std::array<Scope, 16> m_Scopes;
+		size_t m_Depth = 0;
+		size_t m_Overflow = 0;
+		int m_Next;
+
+	private:
+		// called after every complete value
+		void NextValue()
+		{
+			m_Next = SKIP;
+			if (m_Depth != 0 && m_Overflow == 0)
+			{
+				Scope const &scope = m_Scopes[m_Depth - 1];
+				if (scope.IsArray && scope.Node != SKIP)
+					m_Next = GetElementNode(scope.Node);
+			}
+		}
+		bool Push(bool is_array)
+		{
+			if (m_Overflow != 0 || m_Depth == m_Scopes.size())
+			{
+				++m_Overflow;
+				m_Next = SKIP;
+				return true;
+			}
+
+			m_Scopes[m_Depth++] = Scope{ m_Next, is_array };
+			NextValue();
+			return true;
+		}
+		bool Pop()
+		{
+			if (m_Overflow != 0)
+				--m_Overflow;
+			else if (m_Depth != 0)
+				--m_Depth;
+			NextValue();
+			return true;
+		}
+
+	public: // json_sax_t
+		bool null() override
+		{
+			if (m_Next != SKIP)
+				OnNull(m_Next);
+			NextValue();
+			return true;
+		}
+		bool boolean(bool val) override
+		{
+			if (m_Next != SKIP)
+				OnBool(m_Next, val);
+			NextValue();
+			return true;
+		}
+		bool number_integer(number_integer_t) override
+		{
+			NextValue();
+			return true;
+		}
+		bool number_unsigned(number_unsigned_t) override
+		{
+			NextValue();
+			return true;
+		}
+		bool number_float(number_float_t, const string_t &) override
+		{
+			NextValue();
+			return true;
+		}
+		bool string(string_t &val) override
+		{
+			if (m_Next != SKIP)
+				OnString(m_Next, val);
+			NextValue();
+			return true;
+		}
+		bool start_object(std::size_t) override
+		{
+			return Push(false);
+		}
+		bool key(string_t &val) override
+		{
+			m_Next = SKIP;
+			if (m_Overflow != 0 || m_Depth == 0)
+				return true;
+
+			int const parent = m_Scopes[m_Depth - 1].Node;
+			if (parent == ROOT)
+				m_Next = val == "d" ? DATA : SKIP;
+			else if (parent != SKIP)
+				m_Next = GetMemberNode(parent, val);
+			return true;
+		}
+		bool end_object() override
+		{
+			return Pop();
+		}
+		bool start_array(std::size_t) override
+		{
+			return Push(true);
+		}
+		bool end_array() override
+		{
+			return Pop();
+		}
+		bool parse_error(std::size_t, const std::string &,
+			const nlohmann::detail::exception &) override
+		{
+			return false;
+		}
+	};
+
+	class MessageDecoder : public SaxDecoder
+	{
+	public:
+		MessageDecoder(gateway::Message &dest, bool envelope) :
+			SaxDecoder(envelope),
+			m_Dest(dest)
+		{ }
+
+	private:
+		enum Node
+		{
+			ID = DATA + 1,
+			CHANNEL_ID,
+			GUILD_ID,
+			AUTHOR,
+			AUTHOR_ID,
+			CONTENT,
+			TTS,
+			MENTION_EVERYONE,
+			MENTIONS,
+			MENTION,
+			MENTION_ID,
+			MENTION_ROLES,
+			MENTION_ROLE
+		};
+		gateway::Message &m_Dest;
+
+		int GetMemberNode(int parent, std::string const &key) override
+		{
+			if (parent == DATA)
+			{
+				if (key == "id") return ID;
+				if (key == "channel_id") return CHANNEL_ID;
+				if (key == "guild_id") return GUILD_ID;
+				if (key == "author") return AUTHOR;
+				if (key == "content") return CONTENT;
+				if (key == "tts") return TTS;
+				if (key == "mention_everyone") return MENTION_EVERYONE;
+				if (key == "mentions") return MENTIONS;
+				if (key == "mention_roles") return MENTION_ROLES;
+			}
+			else if (parent == AUTHOR && key == "id")
+			{
+				return AUTHOR_ID;
+			}
+			else if (parent == MENTION && key == "id")
+			{
+				return MENTION_ID;
+			}
+			return SKIP;
+		}
+		int GetElementNode(int parent) override
+		{
+			if (parent == MENTIONS)
+				return MENTION;
+			if (parent == MENTION_ROLES)
+				return MENTION_ROLE;
+			return SKIP;
+		}
+		void OnString(int node, std::string const &value) override
+		{
+			switch (node)
+			{
+			case ID: m_Dest.Id = value; break;
+			case CHANNEL_ID: m_Dest.ChannelId = value; break;
+			case GUILD_ID: m_Dest.GuildId = value; break;
+			case AUTHOR_ID: m_Dest.AuthorId = value; break;
+			case CONTENT: m_Dest.Content = value; break;
+			case MENTION_ID: m_Dest.UserMentions.push_back(value); break;
+			case MENTION_ROLE: m_Dest.RoleMentions.push_back(value); break;
+			}
+		}
+		void OnBool(int node, bool value) override
+		{
+			if (node == TTS)
+				m_Dest.IsTts = value;
+			else if (node == MENTION_EVERYONE)
+				m_Dest.MentionsEveryone = value;
+		}
+	};
+
+	class GuildMemberUpdateDecoder : public SaxDecoder
+	{
+	public:
+		explicit GuildMemberUpdateDecoder(gateway::GuildMemberUpdate &dest) :
+			SaxDecoder(true),
+			m_Dest(dest)
+		{ }
+
+	private:
+		enum Node
+		{
+			GUILD_ID = DATA + 1,
+			USER,
+			USER_ID,
+			USER_USERNAME,
+			USER_DISCRIMINATOR,
+			USER_BOT,
+			USER_VERIFIED,
+			ROLES,
+			ROLE,
+			NICK
+		};
+		gateway::GuildMemberUpdate &m_Dest;
+
+		int GetMemberNode(int parent, std::string const &key) override
+		{
+			if (parent == DATA)
+			{
+				if (key == "guild_id") return GUILD_ID;
+				if (key == "user") return USER;
+				if (key == "roles") return ROLES;
+				if (key == "nick") return NICK;
+			}
+			else if (parent == USER)
+			{
+				if (key == "id") return USER_ID;
+				if (key == "username") return USER_USERNAME;
+				if (key == "discriminator") return USER_DISCRIMINATOR;
+				if (key == "bot") return USER_BOT;
+				if (key == "verified") return USER_VERIFIED;
+			}
+			return SKIP;
+		}
+		int GetElementNode(int parent) override
+		{
+			return parent == ROLES ? ROLE : SKIP;
+		}
+		void OnString(int node, std::string const &value) override
+		{
+			switch (node)
+			{
+			case GUILD_ID: m_Dest.GuildId = value; break;
+			case USER_ID: m_Dest.User.Id = value; break;
+			case USER_USERNAME: m_Dest.User.Username = value; break;
+			case USER_DISCRIMINATOR: m_Dest.User.Discriminator = value; break;
+			case ROLE: m_Dest.Roles.push_back(value); break;
+			case NICK:
+				m_Dest.HasNickname = true;
+				m_Dest.Nickname = value;
+				break;
+			}
+		}
+		void OnBool(int node, bool value) override
+		{
+			if (node == USER_BOT)
+				m_Dest.User.IsBot = value;
+			else if (node == USER_VERIFIED)
+				m_Dest.User.IsVerified = value;
+		}
+		void OnNull(int node) override
+		{
+			if (node == NICK)
+			{
+				m_Dest.HasNickname = true;
+				m_Dest.Nickname.clear();
+			}
+		}
+	};
+
+	class PresenceUpdateDecoder : public SaxDecoder
+	{
+	public:
+		explicit PresenceUpdateDecoder(gateway::PresenceUpdate &dest) :
+			SaxDecoder(true),
+			m_Dest(dest)
+		{ }
+
+	private:
+		enum Node
+		{
+			GUILD_ID = DATA + 1,
+			USER,
+			USER_ID,
+			STATUS
+		};
+		gateway::PresenceUpdate &m_Dest;
+
+		int GetMemberNode(int parent, std::string const &key) override
+		{
+			if (parent == DATA)
+			{
+				if (key == "guild_id") return GUILD_ID;
+				if (key == "user") return USER;
+				if (key == "status") return STATUS;
+			}
+			else if (parent == USER && key == "id")
+			{
+				return USER_ID;
+			}
+			return SKIP;
+		}
+		void OnString(int node, std::string const &value) override
+		{
+			switch (node)
+			{
+			case GUILD_ID: m_Dest.GuildId = value; break;
+			case USER_ID: m_Dest.UserId = value; break;
+			case STATUS: m_Dest.Status = value; break;
+			}
+		}
+	};
+
+	class VoiceStateUpdateDecoder : public SaxDecoder
+	{
+	public:
+		explicit VoiceStateUpdateDecoder(gateway::VoiceStateUpdate &dest) :
+			SaxDecoder(true),
+			m_Dest(dest)
+		{ }
+
+	private:
+		enum Node
+		{
+			GUILD_ID = DATA + 1,
+			USER_ID,
+			CHANNEL_ID
+		};
+		gateway::VoiceStateUpdate &m_Dest;
+
+		int GetMemberNode(int parent, std::string const &key) override
+		{
+			if (parent == DATA)
+			{
+				if (key == "guild_id") return GUILD_ID;
+				if (key == "user_id") return USER_ID;
+				if (key == "channel_id") return CHANNEL_ID;
+			}
+			return SKIP;
+		}
+		void OnString(int node, std::string const &value) override
+		{
+			switch (node)
+			{
+			case GUILD_ID: m_Dest.GuildId = value; break;
+			case USER_ID: m_Dest.UserId = value; break;
+			case CHANNEL_ID: m_Dest.ChannelId = value; break;
+			}
+		}
+	};
+}
+
+namespace gateway
+{
+	bool Decode(const char *payload, size_t length, Message &dest)
+	{
+		MessageDecoder decoder(dest, true);
+		return decoder.Parse(payload, length)
+			&& dest.Id.IsValid() && dest.ChannelId.IsValid() && dest.AuthorId.IsValid();
+	}
+
+	bool Decode(const char *payload, size_t length, GuildMemberUpdate &dest)
+	{
+		GuildMemberUpdateDecoder decoder(dest);
+		return decoder.Parse(payload, length)
+			&& dest.GuildId.IsValid() && dest.User.Id.IsValid();
+	}
+
+	bool Decode(const char *payload, size_t length, PresenceUpdate &dest)
+	{
+		PresenceUpdateDecoder decoder(dest);
+		return decoder.Parse(payload, length)
+			&& dest.GuildId.IsValid() && dest.UserId.IsValid() && !dest.Status.empty();
+	}
+
+	bool Decode(const char *payload, size_t length, VoiceStateUpdate &dest)
+	{
+		VoiceStateUpdateDecoder decoder(dest);
+		return decoder.Parse(payload, length)
+			&& dest.GuildId.IsValid() && dest.UserId.IsValid();
+	}
+
+	bool DecodeMessage(std::string const &data, Message &dest)
+	{
+		MessageDecoder decoder(dest, false);
+		return decoder.Parse(data.data(), data.size())
+			&& dest.Id.IsValid() && dest.ChannelId.IsValid() && dest.AuthorId.IsValid();
+	}
+}
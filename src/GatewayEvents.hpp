@@ -0,0 +1,69 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <string>
+#include <vector>
+
+
+// Compact representations of the gateway events which are handled without
+// building a JSON tree first. Only the fields we actually read are kept,
+// everything else in the payload is skipped while parsing.
+namespace gateway
+{
+	struct User
+	{
+		Snowflake_t Id;
+		std::string Username;
+		std::string Discriminator;
+		bool IsBot = false;
+		bool IsVerified = false;
+	};
+
+	// MESSAGE_CREATE, also used for message objects returned by the REST API
+	struct Message
+	{
+		Snowflake_t Id;
+		Snowflake_t ChannelId;
+		Snowflake_t GuildId; // empty for DMs
+		Snowflake_t AuthorId;
+		std::string Content;
+		bool IsTts = false;
+		bool MentionsEveryone = false;
+		std::vector<Snowflake_t> UserMentions;
+		std::vector<Snowflake_t> RoleMentions;
+	};
+
+	struct GuildMemberUpdate
+	{
+		Snowflake_t GuildId;
+		gateway::User User;
+		std::vector<Snowflake_t> Roles;
+		bool HasNickname = false; // "nick" was sent, empty means it was removed
+		std::string Nickname;
+	};
+
+	struct PresenceUpdate
+	{
+		Snowflake_t GuildId;
+		Snowflake_t UserId;
+		std::string Status;
+	};
+
+	struct VoiceStateUpdate
+	{
+		Snowflake_t GuildId;
+		Snowflake_t UserId;
+		Snowflake_t ChannelId; // empty when the user left the voice channel
+	};
+
+	// decode the "d" object of a raw gateway payload; return false if the
+	// payload is malformed or misses required fields
+	bool Decode(const char *payload, size_t length, Message &dest);
+	bool Decode(const char *payload, size_t length, GuildMemberUpdate &dest);
+	bool Decode(const char *payload, size_t length, PresenceUpdate &dest);
+	bool Decode(const char *payload, size_t length, VoiceStateUpdate &dest);
+
+	// decodes a message object which isn't wrapped in a gateway payload
+	bool DecodeMessage(std::string const &data, Message &dest);
+}
@@ -0,0 +1,94 @@
+#include "GatewayRecorder.hpp"
+#include "Logger.hpp"
+
+#include <chrono>
+#include <cstring>
+
+
+const char GatewayRecorder::MAGIC[8] = { 'D', 'C', 'C', 'G', 'W', 'R', 'E', 'C' };
+const uint32_t GatewayRecorder::VERSION;
+const uint32_t GatewayRecorder::MAX_FRAME_LENGTH;
+constexpr double GatewayRecorder::MIN_REPLAY_SPEED;
+
+GatewayRecorder::~GatewayRecorder()
+{
+	std::lock_guard<std::mutex> lock(m_StreamMtx);
+	if (m_Stream.is_open())
+		m_Stream.close();
+}
+
+void GatewayRecorder::Configure(std::string const &record_file,
+	std::string const &replay_file, double replay_speed)
+{
+	m_RecordFile = record_file;
+	m_ReplayFile = replay_file;
+	m_ReplaySpeed = replay_speed <= 0.0 ? 0.0 : replay_speed;
+	if (m_ReplaySpeed > 0.0 && m_ReplaySpeed < MIN_REPLAY_SPEED)
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"gateway replay speed {} is too slow, using {} instead",
+			m_ReplaySpeed, MIN_REPLAY_SPEED);
+		m_ReplaySpeed = MIN_REPLAY_SPEED;
+	}
+
+	// replayed traffic is never recorded again
+	if (m_RecordFile.empty() || IsReplaying())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_StreamMtx);
+	m_Stream.open(m_RecordFile, std::ios::binary | std::ios::app | std::ios::ate);
+	if (!m_Stream)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"can't open gateway record file '{}'", m_RecordFile);
+		return;
+	}
+
+	if (m_Stream.tellp() == 0)
+	{
+		m_Stream.write(MAGIC, sizeof(MAGIC));
+		m_Stream.write(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION));
+	}
+
+	Logger::Get()->Log(samplog_LogLevel::INFO,
+		"recording gateway traffic to '{}'", m_RecordFile);
+	m_Recording = true;
+}
+
+void GatewayRecorder::WriteFrame(int opcode, const char *payload, size_t length)
+{
+	FrameHeader header;
+	header.Timestamp = static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+	header.Opcode = static_cast<int32_t>(opcode);
+	header.Length = static_cast<uint32_t>(length);
+
+	std::lock_guard<std::mutex> lock(m_StreamMtx);
+	m_Stream.write(reinterpret_cast<const char *>(&header.Timestamp), sizeof(header.Timestamp));
+	m_Stream.write(reinterpret_cast<const char *>(&header.Opcode), sizeof(header.Opcode));
+	m_Stream.write(reinterpret_cast<const char *>(&header.Length), sizeof(header.Length));
+	m_Stream.write(payload, length);
+	// the frames right before a crash are the ones a recording is made for
+	m_Stream.flush();
+}
+
+bool GatewayRecorder::ReadHeader(std::istream &stream)
+{
+	char magic[sizeof(MAGIC)];
+	uint32_t version;
+	if (!stream.read(magic, sizeof(magic))
+		|| !stream.read(reinterpret_cast<char *>(&version), sizeof(version)))
+	{
+		return false;
+	}
+
+	return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && version == VERSION;
+}
+
+bool GatewayRecorder::ReadFrameHeader(std::istream &stream, FrameHeader &dest)
+{
+	return stream.read(reinterpret_cast<char *>(&dest.Timestamp), sizeof(dest.Timestamp))
+		&& stream.read(reinterpret_cast<char *>(&dest.Opcode), sizeof(dest.Opcode))
+		&& stream.read(reinterpret_cast<char *>(&dest.Length), sizeof(dest.Length));
+}
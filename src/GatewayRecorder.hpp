@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Singleton.hpp"
+
+#include <string>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <cstdint>
+
+
+// Records every inbound gateway frame to an append-only file, and holds the
+// settings for replaying such a file instead of connecting to Discord.
+//
+// File format (native byte order):
+//   header: "DCCGWREC", uint32 version
+//   frame:  uint64 timestamp (microseconds since epoch), int32 opcode,
+//           uint32 payload length, payload
+class GatewayRecorder : public Singleton<GatewayRecorder>
+{
+	friend class Singleton<GatewayRecorder>;
+public:
+	struct FrameHeader
+	{
+		uint64_t Timestamp;
+		int32_t Opcode;
+		uint32_t Length;
+	};
+	// gateway payloads are far smaller, longer frames mean the file is corrupt
+	static const uint32_t MAX_FRAME_LENGTH = 16 * 1024 * 1024;
+	// slower replay speeds are raised to this, so gaps stay below a minute
+	static constexpr double MIN_REPLAY_SPEED = 0.1;
+
+private:
+	GatewayRecorder() = default;
+	~GatewayRecorder();
+
+private:
+	static const char MAGIC[8];
+	static const uint32_t VERSION = 1;
+
+	std::string
+		m_RecordFile,
+		m_ReplayFile;
+	double m_ReplaySpeed = 1.0;
+
+	bool m_Recording = false;
+	std::ofstream m_Stream;
+	std::mutex m_StreamMtx;
+
+public:
+	void Configure(std::string const &record_file,
+		std::string const &replay_file, double replay_speed);
+
+	inline bool IsReplaying() const
+	{
+		return !m_ReplayFile.empty();
+	}
+	inline std::string const &GetReplayFile() const
+	{
+		return m_ReplayFile;
+	}
+	// 0 replays as fast as possible
+	inline double GetReplaySpeed() const
+	{
+		return m_ReplaySpeed;
+	}
+
+	// does nothing unless recording is enabled
+	inline void Record(int opcode, const char *payload, size_t length)
+	{
+		if (m_Recording)
+			WriteFrame(opcode, payload, length);
+	}
+
+	static bool ReadHeader(std::istream &stream);
+	static bool ReadFrameHeader(std::istream &stream, FrameHeader &dest);
+
+private:
+	void WriteFrame(int opcode, const char *payload, size_t length);
+};
@@ -8,8 +8,12 @@
 #include "utils.hpp"
 
 #include <unordered_map>
+#include <algorithm>
 
 
+const unsigned int Guild::MISSING_MEMBER_RETRY_SECONDS;
+const unsigned int GuildManager::MEMBER_REQUEST_TIMEOUT_SECONDS;
+
 Guild::Guild(GuildId_t pawn_id, json const &data) :
 	m_PawnId(pawn_id)
 {
@@ -58,7 +62,10 @@ Guild::Guild(GuildId_t pawn_id, json const &data) :
 
 	if (utils::IsValidJson(data, "members", json::value_t::array))
 	{
-		for (auto &m : data["members"])
+		auto const &members = data["members"];
+		m_Members.reserve(members.size());
+		m_MemberIndex.reserve(members.size());
+		for (auto &m : members)
 		{
 			if (!utils::IsValidJson(m, "user", json::value_t::object))
 			{
@@ -76,9 +83,11 @@ Guild::Guild(GuildId_t pawn_id, json const &data) :
 			AddMember(std::move(member));
 		}
 
+		// in lazy mode members are only requested when a script needs them
 		unsigned int member_count;
-		if (!utils::TryGetJsonValue(data, member_count, "member_count")
-			|| member_count != m_Members.size())
+		if (!GuildManager::Get()->IsLazyMemberLoading()
+			&& (!utils::TryGetJsonValue(data, member_count, "member_count")
+				|| member_count != m_Members.size()))
 		{
 			Network::Get()->WebSocket().RequestGuildMembers(m_Id);
 		}
@@ -104,17 +113,12 @@ Guild::Guild(GuildId_t pawn_id, json const &data) :
 				break;
 			}
 
-			Channel_t const &channel = ChannelManager::Get()->FindChannelById(channel_id);			
-						
-			for (auto &m : m_Members)
-			{
-				User_t const &user = UserManager::Get()->FindUser(m.UserId);
-				if (user && user->GetId() == user_id)
-				{
-					m.UpdateVoiceChannel(channel ? channel->GetPawnId() : INVALID_CHANNEL_ID);
-					break;
-				}
-			}
+			Member *member = FindMemberById(user_id);
+			if (member == nullptr)
+				continue;
+
+			Channel_t const &channel = ChannelManager::Get()->FindChannelById(channel_id);
+			SetMemberVoiceState(*member, channel ? channel->GetPawnId() : INVALID_CHANNEL_ID);
 		}
 	}
 
@@ -140,16 +144,9 @@ Guild::Guild(GuildId_t pawn_id, json const &data) :
 				break;
 			}
 
-			for (auto &m : m_Members)
-			{
-				User_t const &user = UserManager::Get()->FindUser(m.UserId);
-				assert(user);
-				if (user->GetId() == userid)
-				{
-					m.UpdatePresence(status);
-					break;
-				}
-			}
+			Member *member = FindMemberById(userid);
+			if (member != nullptr)
+				SetMemberStatus(*member, Member::ParsePresenceStatus(status));
 		}
 	}
 }
@@ -169,17 +166,7 @@ void Guild::Member::Update(json const &data)
 				break;
 			}
 
-			Snowflake_t sfid = mr.get<std::string>();
-			Role_t const &role = RoleManager::Get()->FindRoleById(sfid);
-			if (role)
-			{
-				Roles.push_back(role->GetPawnId());
-			}
-			else
-			{
-				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update member role: role id \"{}\" not cached", sfid);
-			}
+			AddRole(mr.get_ref<std::string const &>());
 		}
 	}
 
@@ -196,9 +183,32 @@ void Guild::Member::Update(json const &data)
 	}
 }
 
-void Guild::Member::UpdatePresence(std::string const &status)
+void Guild::Member::Update(gateway::GuildMemberUpdate const &data)
+{
+	Roles.clear();
+	for (auto const &role_id : data.Roles)
+		AddRole(role_id);
+
+	if (data.HasNickname)
+		Nickname = data.Nickname;
+}
+
+void Guild::Member::AddRole(Snowflake_t const &role_id)
+{
+	Role_t const &role = RoleManager::Get()->FindRoleById(role_id);
+	if (role)
+	{
+		Roles.push_back(role->GetPawnId());
+	}
+	else
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"can't update member role: role id \"{}\" not cached", role_id);
+	}
+}
+
+Guild::Member::PresenceStatus Guild::Member::ParsePresenceStatus(std::string const &status)
 {
-	// "idle", "dnd", "online", or "offline"
 	static const std::unordered_map<std::string, Member::PresenceStatus> status_map{
 		{ "idle", Member::PresenceStatus::IDLE },
 		{ "dnd", Member::PresenceStatus::DO_NOT_DISTURB },
@@ -206,52 +216,98 @@ void Guild::Member::UpdatePresence(std::string const &status)
 		{ "offline", Member::PresenceStatus::OFFLINE }
 	};
 
-	Status = status_map.at(status);
+	return status_map.at(status);
 }
 
-void Guild::Member::UpdateVoiceChannel(ChannelId_t const &Channel)
+Guild::Member *Guild::FindMemberById(Snowflake_t const &user_id)
 {
-	VoiceChannel = Channel;
+	User_t const &user = UserManager::Get()->FindUserById(user_id);
+	return user ? FindMember(user->GetPawnId()) : nullptr;
 }
 
-void Guild::UpdateMember(UserId_t userid, json const &data)
+void Guild::UpdateMember(UserId_t userid, gateway::GuildMemberUpdate const &data)
 {
-	for (auto &m : m_Members)
+	Member *member = FindMember(userid);
+	if (member)
 	{
-		if (m.UserId != userid)
-			continue;
-
-		m.Update(data);
-		break;
+		member->Update(data);
+		UpdateMemberRoleSet(*member);
+		InvalidateMemberPermissions(userid);
 	}
 }
 
 void Guild::UpdateMemberPresence(UserId_t userid, std::string const &status)
 {
-	for (auto &m : m_Members)
-	{
-		if (m.UserId != userid)
-			continue;
-
-		m.UpdatePresence(status);
-		break;
-	}
+	Member *member = FindMember(userid);
+	if (member)
+		SetMemberStatus(*member, Member::ParsePresenceStatus(status));
 }
 
 void Guild::UpdateMemberVoiceChannel(UserId_t user_id, ChannelId_t const &channel)
 {
-	for (auto &m : m_Members)
+	Member *member = FindMember(user_id);
+	if (member)
+		SetMemberVoiceState(*member, channel);
+}
+
+void Guild::SetMemberStatus(Member &member, Member::PresenceStatus status)
+{
+	if (member.Status == status)
+		return;
+
+	TrackMember(member, false);
+	member.Status = status;
+	TrackMember(member, true);
+}
+
+void Guild::SetMemberVoiceState(Member &member, ChannelId_t channel)
+{
+	if (member.VoiceChannel == channel)
+		return;
+
+	TrackMember(member, false);
+	member.VoiceChannel = channel;
+	TrackMember(member, true);
+}
+
+// adds the member to or removes it from the status counts and the voice
+// channel occupancy, which have to reflect every cached member exactly once
+void Guild::TrackMember(Member const &member, bool add)
+{
+	unsigned int &count = m_StatusCounts.at(static_cast<size_t>(member.Status));
+	if (add)
+		++count;
+	else if (count != 0)
+		--count;
+
+	if (member.VoiceChannel == INVALID_CHANNEL_ID)
+		return;
+
+	if (add)
 	{
-		if (m.UserId != user_id)
-			continue;
+		m_VoiceChannelMembers[member.VoiceChannel].push_back(member.UserId);
+		return;
+	}
 
-		m.UpdateVoiceChannel(channel);
-		break;
+	auto it = m_VoiceChannelMembers.find(member.VoiceChannel);
+	if (it == m_VoiceChannelMembers.end())
+		return;
+
+	auto &users = it->second;
+	auto user_it = std::find(users.begin(), users.end(), member.UserId);
+	if (user_it != users.end())
+	{
+		*user_it = users.back();
+		users.pop_back();
 	}
+	if (users.empty())
+		m_VoiceChannelMembers.erase(it);
 }
 
 void Guild::Update(json const &data)
 {
+	InvalidateMemberPermissions(); // the owner might have changed
+
 	utils::TryGetJsonValue(data, m_Name, "name");
 
 	utils::TryGetJsonValue(data, m_OwnerId, "owner_id");
@@ -270,11 +326,257 @@ void Guild::Update(json const &data)
 
 			auto const &role = RoleManager::Get()->FindRoleById(role_id);
 			if (role)
-				role->Update(r);
+				UpdateRole(role, r);
 			else
-				m_Roles.push_back(RoleManager::Get()->AddRole(r));
+				AddRole(RoleManager::Get()->AddRole(r));
+		}
+	}
+}
+
+void Guild::AddRole(RoleId_t id)
+{
+	InvalidateMemberPermissions();
+	m_Roles.push_back(id);
+
+	Role_t const &role = RoleManager::Get()->FindRole(id);
+	if (role)
+		m_RoleNames.Add(role->GetName(), id);
+
+	if (id == INVALID_ROLE_ID || m_RoleSlots.count(id) != 0)
+		return;
+
+	// reuse the slot of a deleted role if there is one
+	unsigned int slot = 0;
+	while (slot != m_SlotRoles.size() && m_SlotRoles[slot] != INVALID_ROLE_ID)
+		++slot;
+	if (slot == MAX_ROLE_SLOTS)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"can't assign role slot to role '{}': guild '{}' has too many roles", id, m_PawnId);
+		return;
+	}
+
+	if (slot == m_SlotRoles.size())
+		m_SlotRoles.push_back(id);
+	else
+		m_SlotRoles[slot] = id;
+	m_RoleSlots.emplace(id, slot);
+}
+
+void Guild::RemoveRole(RoleId_t id)
+{
+	InvalidateMemberPermissions();
+	for (auto it = m_Roles.begin(); it != m_Roles.end(); it++)
+	{
+		if (*it == id)
+		{
+			m_Roles.erase(it);
+			break;
+		}
+	}
+
+	Role_t const &role = RoleManager::Get()->FindRole(id);
+	if (role)
+		m_RoleNames.Remove(role->GetName(), id);
+
+	auto slot_it = m_RoleSlots.find(id);
+	if (slot_it == m_RoleSlots.end())
+		return;
+
+	// the slot may be handed to another role, so the deleted one has to be
+	// gone from all members
+	unsigned int const slot = slot_it->second;
+	for (auto &m : m_Members)
+	{
+		if (!m.RoleSet.test(slot))
+			continue;
+
+		m.RoleSet.reset(slot);
+		m.Roles.erase(std::remove(m.Roles.begin(), m.Roles.end(), id), m.Roles.end());
+	}
+	m_SlotRoles[slot] = INVALID_ROLE_ID;
+	m_RoleSlots.erase(slot_it);
+}
+
+void Guild::UpdateMemberRoleSet(Member &member) const
+{
+	member.RoleSet.reset();
+	for (auto role_id : member.Roles)
+	{
+		auto it = m_RoleSlots.find(role_id);
+		if (it != m_RoleSlots.end())
+			member.RoleSet.set(it->second);
+	}
+}
+
+void Guild::UpdateRole(Role_t const &role, json const &data)
+{
+	std::string const old_name = role->GetName();
+	role->Update(data);
+	m_RoleNames.Rename(old_name, role->GetName(), role->GetPawnId());
+	InvalidateMemberPermissions();
+}
+
+void Guild::QueryMembers(MemberFilter const &filter, size_t max_count,
+	std::vector<UserId_t> &dest) const
+{
+	int role_slot = INVALID_ROLE_SLOT;
+	if (filter.Role != INVALID_ROLE_ID)
+	{
+		role_slot = GetRoleSlot(filter.Role);
+		if (role_slot == INVALID_ROLE_SLOT)
+			return; // no member can have a role of another guild
+	}
+
+	auto const matches = [&](Member const &m)
+	{
+		if (role_slot != INVALID_ROLE_SLOT && !m.RoleSet.test(role_slot))
+			return false;
+		if (filter.Status != Member::PresenceStatus::INVALID && m.Status != filter.Status)
+			return false;
+		if (filter.VoiceChannel != INVALID_CHANNEL_ID && m.VoiceChannel != filter.VoiceChannel)
+			return false;
+
+		if (!filter.NamePrefix.empty())
+		{
+			std::string const *name = &m.Nickname;
+			if (name->empty())
+			{
+				User_t const &user = UserManager::Get()->FindUser(m.UserId);
+				if (!user)
+					return false;
+				name = &user->GetUsername();
+			}
+			if (name->compare(0, filter.NamePrefix.size(), filter.NamePrefix) != 0)
+				return false;
+		}
+		return true;
+	};
+
+	size_t count = 0;
+	if (filter.VoiceChannel != INVALID_CHANNEL_ID)
+	{
+		// only the members in that channel can match
+		auto const *users = GetVoiceChannelMembers(filter.VoiceChannel);
+		if (users == nullptr)
+			return;
+
+		for (auto const &userid : *users)
+		{
+			if (count == max_count)
+				break;
+
+			Member const *m = FindMember(userid);
+			if (m == nullptr || !matches(*m))
+				continue;
+
+			dest.push_back(userid);
+			++count;
+		}
+		return;
+	}
+
+	for (auto const &m : m_Members)
+	{
+		if (count == max_count)
+			break;
+
+		if (!matches(m))
+			continue;
+
+		dest.push_back(m.UserId);
+		++count;
+	}
+}
+
+bool Guild::GetMemberPermissions(UserId_t userid, ChannelId_t channelid,
+	unsigned long long int &dest)
+{
+	Member const *member = FindMember(userid);
+	if (member == nullptr)
+		return false;
+
+	static Channel_t const no_channel = nullptr;
+	Channel_t const &channel = channelid != INVALID_CHANNEL_ID
+		? ChannelManager::Get()->FindChannel(channelid) : no_channel;
+	if (channelid != INVALID_CHANNEL_ID && (!channel || channel->GetGuildId() != m_PawnId))
+		return false;
+
+	auto &member_cache = m_PermissionCache[userid];
+	auto it = member_cache.find(channelid);
+	if (it == member_cache.end())
+		it = member_cache.emplace(channelid, ComputeMemberPermissions(*member, channel)).first;
+
+	dest = it->second;
+	return true;
+}
+
+unsigned long long int Guild::ComputeMemberPermissions(Member const &member,
+	Channel_t const &channel) const
+{
+	static const unsigned long long int
+		ALL_PERMISSIONS = ~0ULL,
+		ADMINISTRATOR = 1ULL << 3;
+
+	User_t const &user = UserManager::Get()->FindUser(member.UserId);
+	if (user && user->GetId() == m_OwnerId)
+		return ALL_PERMISSIONS;
+
+	// the @everyone role has the same id as the guild
+	unsigned long long int permissions = 0;
+	Role_t const &everyone_role = RoleManager::Get()->FindRoleById(m_Id);
+	if (everyone_role)
+		permissions = everyone_role->GetPermissions();
+
+	for (auto role_id : member.Roles)
+	{
+		Role_t const &role = RoleManager::Get()->FindRole(role_id);
+		if (role)
+			permissions |= role->GetPermissions();
+	}
+
+	if (permissions & ADMINISTRATOR)
+		return ALL_PERMISSIONS;
+	if (!channel)
+		return permissions;
+
+	// overwrites are applied in order: @everyone, all roles of the member
+	// combined, the member itself
+	Channel::PermissionOverwrite const
+		*everyone_overwrite = nullptr,
+		*member_overwrite = nullptr;
+	unsigned long long int
+		roles_allow = 0,
+		roles_deny = 0;
+	for (auto const &o : channel->GetPermissionOverwrites())
+	{
+		if (o.IsMember)
+		{
+			if (user && o.Id == user->GetId())
+				member_overwrite = &o;
+		}
+		else if (o.Id == m_Id)
+		{
+			everyone_overwrite = &o;
+		}
+		else
+		{
+			Role_t const &role = RoleManager::Get()->FindRoleById(o.Id);
+			if (role && MemberHasRole(member, role->GetPawnId()))
+			{
+				roles_allow |= o.Allow;
+				roles_deny |= o.Deny;
+			}
 		}
 	}
+
+	if (everyone_overwrite != nullptr)
+		permissions = (permissions & ~everyone_overwrite->Deny) | everyone_overwrite->Allow;
+	permissions = (permissions & ~roles_deny) | roles_allow;
+	if (member_overwrite != nullptr)
+		permissions = (permissions & ~member_overwrite->Deny) | member_overwrite->Allow;
+
+	return permissions;
 }
 
 void Guild::SetGuildName(std::string const &name)
@@ -300,7 +602,7 @@ void Guild::SetMemberNickname(User_t const &user, std::string const &nickname)
 	if (!utils::TryDumpJson(data, json_str))
 		Logger::Get()->Log(samplog_LogLevel::ERROR, "can't serialize JSON: {}", json_str);
 
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 		return;
 
 	Network::Get()->Http().Patch(fmt::format(
@@ -320,7 +622,7 @@ void Guild::SetMemberVoiceChannel(User_t const &user, Snowflake_t const &channel
 		return;
 	}
 
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 	{
 		return;
 	}
@@ -332,7 +634,7 @@ void Guild::SetMemberVoiceChannel(User_t const &user, Snowflake_t const &channel
 
 void Guild::AddMemberRole(User_t const &user, Role_t const &role)
 {
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 		return;
 
 	Network::Get()->Http().Put(fmt::format(
@@ -341,7 +643,7 @@ void Guild::AddMemberRole(User_t const &user, Role_t const &role)
 
 void Guild::RemoveMemberRole(User_t const &user, Role_t const &role)
 {
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 		return;
 
 	Network::Get()->Http().Delete(fmt::format(
@@ -350,7 +652,7 @@ void Guild::RemoveMemberRole(User_t const &user, Role_t const &role)
 
 void Guild::KickMember(User_t const &user)
 {
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 		return;
 
 	Network::Get()->Http().Delete(fmt::format(
@@ -359,7 +661,7 @@ void Guild::KickMember(User_t const &user)
 
 void Guild::CreateMemberBan(User_t const &user, std::string const &reason)
 {
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 		return;
 
 	Network::Get()->Http().Put(fmt::format(
@@ -368,7 +670,7 @@ void Guild::CreateMemberBan(User_t const &user, std::string const &reason)
 
 void Guild::RemoveMemberBan(User_t const &user)
 {
-	if (m_MembersSet.count(user->GetPawnId()) == 0)
+	if (!HasMember(user->GetPawnId()))
 		return;
 
 	Network::Get()->Http().Delete(fmt::format(
@@ -439,10 +741,81 @@ void Guild::DeleteRole(Role_t const &role)
 }
 
 
-void GuildManager::Initialize()
+bool Guild::RequestMembers(std::vector<Snowflake_t> const &user_ids, pawn_cb::Callback_t &&callback)
+{
+	if (user_ids.empty() || user_ids.size() > 100) // Discord's limit per request
+		return false;
+
+	Network::Get()->WebSocket().RequestGuildMembers(GetId(), user_ids,
+		GuildManager::Get()->AddMemberRequest(m_PawnId, std::move(callback)));
+	return true;
+}
+
+bool Guild::SearchMembers(std::string const &query, unsigned int limit, pawn_cb::Callback_t &&callback)
+{
+	if (query.empty() || limit == 0 || limit > 100)
+		return false;
+
+	Network::Get()->WebSocket().SearchGuildMembers(GetId(), query, limit,
+		GuildManager::Get()->AddMemberRequest(m_PawnId, std::move(callback)));
+	return true;
+}
+
+bool Guild::RequestMissingMember(UserId_t userid)
+{
+	if (!GuildManager::Get()->IsLazyMemberLoading())
+		return false;
+
+	// a user is only requested once at a time, if it's still missing
+	// after the request finished it's not a member of this guild (yet)
+	auto it = m_MissingMembers.find(userid);
+	if (it != m_MissingMembers.end())
+	{
+		if (it->second.Pending)
+			return true;
+		if (std::chrono::steady_clock::now() < it->second.RetryAfter)
+			return false;
+		m_MissingMembers.erase(it);
+	}
+
+	auto const &user = UserManager::Get()->FindUser(userid);
+	if (!user)
+		return false;
+
+	Logger::Get()->Log(samplog_LogLevel::WARNING,
+		"guild member '{}' is not cached yet, requesting it", user->GetId());
+
+	m_MissingMembers.emplace(userid, MissingMember{ true, {} });
+	Network::Get()->WebSocket().RequestGuildMembers(GetId(), { user->GetId() },
+		GuildManager::Get()->AddMemberRequest(m_PawnId, nullptr, userid));
+	return true;
+}
+
+void Guild::FinishMissingMemberRequest(UserId_t userid, bool answered)
+{
+	// members which arrived were already removed from the missing ones
+	auto it = m_MissingMembers.find(userid);
+	if (it == m_MissingMembers.end())
+		return;
+
+	if (!answered)
+	{
+		m_MissingMembers.erase(it);
+		return;
+	}
+
+	it->second.Pending = false;
+	it->second.RetryAfter = std::chrono::steady_clock::now()
+		+ std::chrono::seconds(MISSING_MEMBER_RETRY_SECONDS);
+}
+
+
+void GuildManager::Initialize(bool lazy_member_loading)
 {
 	assert(m_Initialized != m_InitValue);
 
+	m_LazyMemberLoading = lazy_member_loading;
+
 	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::READY, [this](json const &data)
 	{
 		if (!utils::IsValidJson(data, "guilds", json::value_t::array))
@@ -456,7 +829,21 @@ void GuildManager::Initialize()
 		m_Initialized++;
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_CREATE, [this](json const &data)
+	// member requests sent on a lost connection are never answered, those
+	// sent before a new session started (or an old one resumed) are failed
+	for (auto event : { WebSocket::Event::READY, WebSocket::Event::RESUMED })
+	{
+		Network::Get()->WebSocket().RegisterEvent(event, [this](json &&)
+		{
+			auto const connected = std::chrono::steady_clock::now();
+			PawnDispatcher::Get()->Dispatch([this, connected]()
+			{
+				FailMemberRequests(connected);
+			});
+		});
+	}
+
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_CREATE, [this](json &&data)
 	{
 		if (!m_IsInitialized)
 		{
@@ -465,7 +852,7 @@ void GuildManager::Initialize()
 		}
 		else
 		{
-			PawnDispatcher::Get()->Dispatch([data]() mutable
+			PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 			{
 				auto const guild_id = GuildManager::Get()->AddGuild(data);
 				if (guild_id == INVALID_GUILD_ID)
@@ -506,7 +893,7 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_UPDATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_UPDATE, [](json &&data)
 	{
 		Snowflake_t sfid;
 		if (!utils::TryGetJsonValue(data, sfid, "id"))
@@ -516,7 +903,7 @@ void GuildManager::Initialize()
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data, sfid]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data), sfid]() mutable
 		{
 			Guild_t const &guild = GuildManager::Get()->FindGuildById(sfid);
 			if (!guild)
@@ -534,7 +921,7 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBER_ADD, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBER_ADD, [](json &&data)
 	{
 		if (!utils::IsValidJson(data,
 			"guild_id", json::value_t::string,
@@ -547,7 +934,7 @@ void GuildManager::Initialize()
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			Snowflake_t sfid = data["guild_id"].get<std::string>();
 			auto const &guild = GuildManager::Get()->FindGuildById(sfid);
@@ -572,7 +959,7 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBER_REMOVE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBER_REMOVE, [](json &&data)
 	{
 		if (!utils::IsValidJson(data,
 			"guild_id", json::value_t::string,
@@ -583,7 +970,7 @@ void GuildManager::Initialize()
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			Snowflake_t guild_id = data["guild_id"].get<std::string>();
 			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
@@ -611,46 +998,44 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBER_UPDATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterRawEvent(WebSocket::Event::GUILD_MEMBER_UPDATE,
+		[](const char *payload, size_t length)
 	{
-		if (!utils::IsValidJson(data,
-			"guild_id", json::value_t::string,
-			"user", "id", json::value_t::string))
+		gateway::GuildMemberUpdate data;
+		if (!gateway::Decode(payload, length, data))
 		{
 			Logger::Get()->Log(samplog_LogLevel::ERROR,
-				"invalid JSON: expected \"guild_id\" and \"user.id\" in \"{}\"", data.dump());
+				"invalid JSON: expected \"guild_id\" and \"user.id\" in GUILD_MEMBER_UPDATE event");
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
-			Snowflake_t guild_id = data["guild_id"].get<std::string>();
-			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
+			auto const &guild = GuildManager::Get()->FindGuildById(data.GuildId);
 			if (!guild)
 			{
 				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update guild member: guild id \"{}\" not cached", guild_id);
+					"can't update guild member: guild id \"{}\" not cached", data.GuildId);
 				return;
 			}
 
-			Snowflake_t user_id = data["user"]["id"].get<std::string>();
-			auto const &user = UserManager::Get()->FindUserById(user_id);
+			auto const &user = UserManager::Get()->FindUserById(data.User.Id);
 			if (!user)
 			{
 				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update guild member: user id \"{}\" not cached", user_id);
+					"can't update guild member: user id \"{}\" not cached", data.User.Id);
 				return;
 			}
 
 			guild->UpdateMember(user->GetPawnId(), data);
-			user->Update(data["user"]);
+			user->Update(data.User);
 			// forward DCC_OnGuildMemberUpdate(DCC_Guild:guild, DCC_User:user);
 			pawn_cb::Error error;
 			pawn_cb::Callback::CallFirst(error, "DCC_OnGuildMemberUpdate", guild->GetPawnId(), user->GetPawnId());
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_ROLE_CREATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_ROLE_CREATE, [](json &&data)
 	{
 		if (!utils::IsValidJson(data,
 			"guild_id", json::value_t::string,
@@ -661,7 +1046,7 @@ void GuildManager::Initialize()
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			Snowflake_t guild_id = data["guild_id"].get<std::string>();
 			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
@@ -681,7 +1066,7 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_ROLE_DELETE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_ROLE_DELETE, [](json &&data)
 	{
 		if (!utils::IsValidJson(data,
 			"guild_id", json::value_t::string,
@@ -692,7 +1077,7 @@ void GuildManager::Initialize()
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			Snowflake_t guild_id = data["guild_id"].get<std::string>();
 			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
@@ -721,7 +1106,7 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_ROLE_UPDATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_ROLE_UPDATE, [](json &&data)
 	{
 		if (!utils::IsValidJson(data,
 			"guild_id", json::value_t::string,
@@ -732,7 +1117,7 @@ void GuildManager::Initialize()
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			Snowflake_t guild_id = data["guild_id"].get<std::string>();
 			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
@@ -752,7 +1137,7 @@ void GuildManager::Initialize()
 				return;
 			}
 
-			role->Update(data["role"]);
+			guild->UpdateRole(role, data["role"]);
 
 			// forward DCC_OnGuildRoleUpdate(DCC_Guild:guild, DCC_Role:role);
 			pawn_cb::Error error;
@@ -760,51 +1145,40 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::PRESENCE_UPDATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterRawEvent(WebSocket::Event::PRESENCE_UPDATE,
+		[](const char *payload, size_t length)
 	{
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		gateway::PresenceUpdate data;
+		if (!gateway::Decode(payload, length, data))
 		{
-			std::string guild_id;
-			if (!utils::TryGetJsonValue(data, guild_id, "guild_id"))
-			{
-				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"invalid JSON: expected \"guild_id\" in \"{}\"", data.dump());
-				return;
-			}
-
-			std::string user_id;
-			if (!utils::TryGetJsonValue(data, user_id, "user", "id"))
-			{
-				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"invalid JSON: expected \"user.id\" in \"{}\"", data.dump());
-				return;
-			}
+			Logger::Get()->Log(samplog_LogLevel::ERROR,
+				"invalid JSON: expected \"guild_id\", \"user.id\" and \"status\" in PRESENCE_UPDATE event");
+			return;
+		}
 
-			std::string status;
-			if (!utils::TryGetJsonValue(data, status, "status"))
-			{
-				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"invalid JSON: expected \"status\" in \"{}\"", data.dump());
-				return;
-			}
+		// only the latest presence of a member matters, so pending updates
+		// get collapsed when the server can't keep up
+		std::string task_key = fmt::format("PRESENCE_UPDATE:{}:{}", data.GuildId, data.UserId);
 
-			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
+		PawnDispatcher::Get()->DispatchCollapsible(std::move(task_key), [data = std::move(data)]() mutable
+		{
+			auto const &guild = GuildManager::Get()->FindGuildById(data.GuildId);
 			if (!guild)
 			{
 				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update guild member presence: guild id \"{}\" not cached", guild_id);
+					"can't update guild member presence: guild id \"{}\" not cached", data.GuildId);
 				return;
 			}
 
-			auto const &user = UserManager::Get()->FindUserById(user_id);
+			auto const &user = UserManager::Get()->FindUserById(data.UserId);
 			if (!user)
 			{
 				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update guild member presence: user id \"{}\" not cached", user_id);
+					"can't update guild member presence: user id \"{}\" not cached", data.UserId);
 				return;
 			}
 
-			guild->UpdateMemberPresence(user->GetPawnId(), status);
+			guild->UpdateMemberPresence(user->GetPawnId(), data.Status);
 
 			// forward DCC_OnGuildMemberUpdate(DCC_Guild:guild, DCC_User:user);
 			pawn_cb::Error error;
@@ -812,7 +1186,7 @@ void GuildManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBERS_CHUNK, [](json const &data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::GUILD_MEMBERS_CHUNK, [](json &&data)
 	{
 		Snowflake_t guild_id;
 		if (!utils::TryGetJsonValue(data, guild_id, "guild_id"))
@@ -828,7 +1202,7 @@ void GuildManager::Initialize()
 				"invalid JSON: expected array \"members\" in \"{}\"", data.dump());
 		}
 
-		PawnDispatcher::Get()->Dispatch([guild_id, data]() mutable
+		PawnDispatcher::Get()->Dispatch([guild_id, data = std::move(data)]() mutable
 		{
 			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
 			if (!guild)
@@ -838,6 +1212,10 @@ void GuildManager::Initialize()
 				return;
 			}
 
+			std::string nonce;
+			utils::TryGetJsonValue(data, nonce, "nonce");
+			std::vector<UserId_t> members;
+
 			for (auto &m : data["members"])
 			{
 				if (!utils::IsValidJson(m, "user", json::value_t::object))
@@ -857,51 +1235,59 @@ void GuildManager::Initialize()
 				member.Update(m);
 
 				guild->AddMember(std::move(member));
+				if (!nonce.empty())
+					members.push_back(userid);
+			}
+
+			if (!nonce.empty())
+			{
+				int chunk_index = 0,
+					chunk_count = 1;
+				utils::TryGetJsonValue(data, chunk_index, "chunk_index");
+				utils::TryGetJsonValue(data, chunk_count, "chunk_count");
+				GuildManager::Get()->HandleMemberRequestChunk(
+					nonce, std::move(members), chunk_index + 1 >= chunk_count);
 			}
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::VOICE_STATE_UPDATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterRawEvent(WebSocket::Event::VOICE_STATE_UPDATE,
+		[](const char *payload, size_t length)
 	{
-		if (!utils::IsValidJson(data,
-			"guild_id", json::value_t::string,
-			"user_id", json::value_t::string,
-			"channel_id", json::value_t::string, json::value_t::null))
+		gateway::VoiceStateUpdate data;
+		if (!gateway::Decode(payload, length, data))
 		{
 			Logger::Get()->Log(samplog_LogLevel::ERROR,
-				"invalid JSON: expected \"guild_id\", \"user_id\" and \"channel_id\"in \"{}\"", data.dump());
+				"invalid JSON: expected \"guild_id\", \"user_id\" and \"channel_id\" in VOICE_STATE_UPDATE event");
 			return;
 		}
 
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
-			Snowflake_t const &guild_id = data["guild_id"];
-			auto const &guild = GuildManager::Get()->FindGuildById(guild_id);
+			auto const &guild = GuildManager::Get()->FindGuildById(data.GuildId);
 			if (!guild)
 			{
 				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update guild member voice channel: guild id \"{}\" not cached", guild_id);
+					"can't update guild member voice channel: guild id \"{}\" not cached", data.GuildId);
 				return;
 			}
 
-			Snowflake_t const &user_id = data["user_id"];
-			auto const &user = UserManager::Get()->FindUserById(user_id);
+			auto const &user = UserManager::Get()->FindUserById(data.UserId);
 			if (!user)
 			{
 				Logger::Get()->Log(samplog_LogLevel::ERROR,
-					"can't update guild member voice channel: user id \"{}\" not cached", user_id);
+					"can't update guild member voice channel: user id \"{}\" not cached", data.UserId);
 				return;
 			}
-			
-			auto const &channel_id = data["channel_id"];
-			ChannelId_t channel_PawnId = INVALID_CHANNEL_ID;			
-			if (!channel_id.is_null()) // User joined voice channel, thus check if channel is cached and get its pawnId
+
+			ChannelId_t channel_PawnId = INVALID_CHANNEL_ID;
+			if (data.ChannelId.IsValid()) // User joined voice channel, thus check if channel is cached and get its pawnId
 			{
-				auto const &channel = ChannelManager::Get()->FindChannelById(channel_id);
+				auto const &channel = ChannelManager::Get()->FindChannelById(data.ChannelId);
 				if (!channel)
 				{
 					Logger::Get()->Log(samplog_LogLevel::ERROR,
-						"can't update guild member voice channel: channel id \"{}\" not cached", channel_id.get<Snowflake_t>());
+						"can't update guild member voice channel: channel id \"{}\" not cached", data.ChannelId);
 					return;
 				}
 				channel_PawnId = channel->GetPawnId();
@@ -990,16 +1376,17 @@ GuildId_t GuildManager::AddGuild(json const &data)
 		return INVALID_GUILD_ID;
 	}
 
-	GuildId_t id = 1;
-	while (m_Guilds.find(id) != m_Guilds.end())
-		++id;
-
-	if (!m_Guilds.emplace(id, Guild_t(new Guild(id, data))).second)
+	GuildId_t id = m_Guilds.Emplace([&](void *storage, GuildId_t pawn_id)
+	{
+		return new (storage) Guild(pawn_id, data);
+	});
+	if (id == INVALID_GUILD_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create guild: duplicate key '{}'", id);
+			"can't create guild: out of guild ids");
 		return INVALID_GUILD_ID;
 	}
+	m_GuildIds.emplace(sfid, id);
 
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully created guild with id '{}'", id);
 	return id;
@@ -1007,33 +1394,100 @@ GuildId_t GuildManager::AddGuild(json const &data)
 
 void GuildManager::DeleteGuild(Guild_t const &guild)
 {
-	m_Guilds.erase(guild->GetPawnId());
+	GuildId_t const id = guild->GetPawnId();
+	m_GuildIds.erase(guild->GetId());
+	m_Guilds.Erase(id);
+}
+
+std::string GuildManager::AddMemberRequest(GuildId_t guild,
+	pawn_cb::Callback_t &&callback, UserId_t missing_member)
+{
+	auto nonce = std::to_string(++m_MemberRequestCount);
+	m_MemberRequests.emplace(nonce, MemberRequest{ guild, std::move(callback),
+		missing_member, {}, std::chrono::steady_clock::now() });
+	return nonce;
+}
+
+void GuildManager::ExpireMemberRequests()
+{
+	if (m_MemberRequests.empty())
+		return;
+
+	auto const timeout = std::chrono::steady_clock::now()
+		- std::chrono::seconds(MEMBER_REQUEST_TIMEOUT_SECONDS);
+	FailMemberRequests(timeout);
+}
+
+void GuildManager::FailMemberRequests(std::chrono::steady_clock::time_point time)
+{
+	std::vector<std::string> failed;
+	for (auto const &r : m_MemberRequests)
+	{
+		if (r.second.Sent < time)
+			failed.push_back(r.first);
+	}
+
+	for (auto const &nonce : failed)
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"guild member request '{}' wasn't answered", nonce);
+		FinishMemberRequest(nonce, false);
+	}
+}
+
+void GuildManager::HandleMemberRequestChunk(std::string const &nonce,
+	std::vector<UserId_t> &&members, bool last_chunk)
+{
+	auto it = m_MemberRequests.find(nonce);
+	if (it == m_MemberRequests.end())
+		return;
+
+	auto &request_members = it->second.Members;
+	request_members.insert(request_members.end(), members.begin(), members.end());
+	if (last_chunk)
+		FinishMemberRequest(nonce, true);
+}
+
+void GuildManager::FinishMemberRequest(std::string const &nonce, bool answered)
+{
+	auto it = m_MemberRequests.find(nonce);
+	if (it == m_MemberRequests.end())
+		return;
+
+	MemberRequest request = std::move(it->second);
+	m_MemberRequests.erase(it);
+
+	auto const &guild = FindGuild(request.Guild);
+	if (guild && request.MissingMember != INVALID_USER_ID)
+		guild->FinishMissingMemberRequest(request.MissingMember, answered);
+
+	if (request.Callback)
+	{
+		m_RequestedMembers = std::move(request.Members);
+		request.Callback->Execute();
+		m_RequestedMembers.clear();
+	}
 }
 
 std::vector<GuildId_t> GuildManager::GetAllGuildIds() const
 {
 	std::vector<GuildId_t> guild_ids;
-	for (auto &g : m_Guilds)
-		guild_ids.push_back(g.first);
+	for (Guild_t const &guild : m_Guilds)
+		guild_ids.push_back(guild->GetPawnId());
 
 	return guild_ids;
 }
 
 Guild_t const &GuildManager::FindGuild(GuildId_t id)
 {
-	static Guild_t invalid_guild;
-	auto it = m_Guilds.find(id);
-	if (it == m_Guilds.end())
-		return invalid_guild;
-	return it->second;
+	return m_Guilds.Find(id);
 }
 
 Guild_t const &GuildManager::FindGuildByName(std::string const &name)
 {
 	static Guild_t invalid_guild;
-	for (auto const &g : m_Guilds)
+	for (Guild_t const &guild : m_Guilds)
 	{
-		Guild_t const &guild = g.second;
 		if (guild->GetName().compare(name) == 0)
 			return guild;
 	}
@@ -1043,11 +1497,8 @@ Guild_t const &GuildManager::FindGuildByName(std::string const &name)
 Guild_t const &GuildManager::FindGuildById(Snowflake_t const &sfid)
 {
 	static Guild_t invalid_guild;
-	for (auto const &g : m_Guilds)
-	{
-		Guild_t const &guild = g.second;
-		if (guild->GetId().compare(sfid) == 0)
-			return guild;
-	}
-	return invalid_guild;
+	auto it = m_GuildIds.find(sfid);
+	if (it == m_GuildIds.end())
+		return invalid_guild;
+	return FindGuild(it->second);
 }
\ No newline at end of file
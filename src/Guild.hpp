@@ -2,12 +2,18 @@
 
 #include "Singleton.hpp"
 #include "types.hpp"
+#include "SlotMap.hpp"
+#include "NameIndex.hpp"
 #include "Callback.hpp"
+#include "GatewayEvents.hpp"
 
 #include <string>
 #include <atomic>
 #include <vector>
-#include <unordered_set>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <unordered_map>
 
 #include <json.hpp>
 
@@ -18,6 +24,12 @@ using json = nlohmann::json;
 class Guild
 {
 public:
+	// Discord allows 250 roles per guild, every role of a guild gets a slot
+	// in the role sets of its members
+	static const size_t MAX_ROLE_SLOTS = 256;
+	using RoleSet_t = std::bitset<MAX_ROLE_SLOTS>;
+	static const int INVALID_ROLE_SLOT = -1;
+
 	struct Member
 	{
 		enum class PresenceStatus
@@ -28,17 +40,23 @@ public:
 			DO_NOT_DISTURB = 3,
 			OFFLINE = 4
 		};
+		static const size_t NUM_PRESENCE_STATUSES = 5;
 
 		UserId_t UserId;
 		std::string Nickname;
 		std::vector<RoleId_t> Roles;
-		PresenceStatus Status;
+		RoleSet_t RoleSet; // maintained by the guild from "Roles"
+		// offline members don't get a presence in GUILD_CREATE
+		PresenceStatus Status = PresenceStatus::OFFLINE;
 		ChannelId_t VoiceChannel = INVALID_CHANNEL_ID;
 
 
 		void Update(json const &data);
-		void UpdatePresence(std::string const &status);
-		void UpdateVoiceChannel(ChannelId_t const &channel);
+		void Update(gateway::GuildMemberUpdate const &data);
+		void AddRole(Snowflake_t const &role_id);
+
+		// "idle", "dnd", "online", or "offline"
+		static PresenceStatus ParsePresenceStatus(std::string const &status);
 
 		inline ChannelId_t const &GetVoiceChannel() const
 		{
@@ -46,6 +64,16 @@ public:
 		}
 	};
 
+	// criteria for QueryMembers, unset fields match every member
+	struct MemberFilter
+	{
+		RoleId_t Role = INVALID_ROLE_ID;
+		Member::PresenceStatus Status = Member::PresenceStatus::INVALID;
+		ChannelId_t VoiceChannel = INVALID_CHANNEL_ID;
+		// compared with the nickname, or the username if there is none
+		std::string NamePrefix;
+	};
+
 public:
 	Guild(GuildId_t pawn_id, json const &data);
 	~Guild() = default;
@@ -61,11 +89,40 @@ private:
 	Snowflake_t m_OwnerId;
 
 	std::vector<RoleId_t> m_Roles;
+	NameIndex<RoleId_t> m_RoleNames;
+	std::unordered_map<RoleId_t, unsigned int> m_RoleSlots;
+	std::vector<RoleId_t> m_SlotRoles; // role slot to role, INVALID_ROLE_ID if unused
 	std::vector<ChannelId_t> m_Channels;
 	std::vector<Member> m_Members;
-	std::unordered_set<UserId_t> m_MembersSet;
+	std::unordered_map<UserId_t, size_t> m_MemberIndex; // user to position in m_Members
+	// number of members per presence status, kept in sync with the members
+	std::array<unsigned int, Member::NUM_PRESENCE_STATUSES> m_StatusCounts{};
+	// users currently connected to each voice channel
+	std::unordered_map<ChannelId_t, std::vector<UserId_t>> m_VoiceChannelMembers;
+	// users requested on demand in lazy mode which didn't arrive (yet)
+	struct MissingMember
+	{
+		bool Pending; // the request wasn't answered yet
+		// a user that wasn't found isn't requested again before this
+		std::chrono::steady_clock::time_point RetryAfter;
+	};
+	std::unordered_map<UserId_t, MissingMember> m_MissingMembers;
+	// users may join later, so one that wasn't found is requested again after this
+	static const unsigned int MISSING_MEMBER_RETRY_SECONDS = 60;
+	// computed permissions by member and channel (INVALID_CHANNEL_ID for the
+	// guild-wide permissions)
+	std::unordered_map<UserId_t,
+		std::unordered_map<ChannelId_t, unsigned long long int>> m_PermissionCache;
 
 private:
+	void UpdateMemberRoleSet(Member &member) const;
+	// the only places a member's status or voice channel may be changed,
+	// so the aggregates above stay correct
+	void SetMemberStatus(Member &member, Member::PresenceStatus status);
+	void SetMemberVoiceState(Member &member, ChannelId_t channel);
+	void TrackMember(Member const &member, bool add);
+	unsigned long long int ComputeMemberPermissions(Member const &member,
+		Channel_t const &channel) const;
 
 public:
 	inline GuildId_t GetPawnId() const
@@ -103,6 +160,7 @@ public:
 	}
 	inline void RemoveChannel(ChannelId_t id)
 	{
+		InvalidateMemberPermissions();
 		for (auto it = m_Channels.begin(); it != m_Channels.end(); it++)
 		{
 			if (*it == id)
@@ -115,41 +173,106 @@ public:
 
 	inline void AddMember(Member &&member)
 	{
-		if (m_MembersSet.count(member.UserId) == 1)
+		if (!m_MemberIndex.emplace(member.UserId, m_Members.size()).second)
 			return;
-		m_MembersSet.insert(member.UserId);
+		m_MissingMembers.erase(member.UserId);
+		InvalidateMemberPermissions(member.UserId);
+		UpdateMemberRoleSet(member);
+		TrackMember(member, true);
 		m_Members.push_back(std::move(member));
 	}
+	// the last member takes the place of the removed one, so member offsets
+	// aren't stable across removals
 	inline void RemoveMember(UserId_t userid)
 	{
-		for (auto it = m_Members.begin(); it != m_Members.end(); it++)
+		auto it = m_MemberIndex.find(userid);
+		if (it == m_MemberIndex.end())
+			return;
+
+		size_t const index = it->second;
+		m_MemberIndex.erase(it);
+		InvalidateMemberPermissions(userid);
+		TrackMember(m_Members[index], false);
+		if (index != m_Members.size() - 1)
 		{
-			if ((*it).UserId == userid)
-			{
-				m_Members.erase(it);
-				m_MembersSet.erase(userid);
-				break;
-			}
+			m_Members[index] = std::move(m_Members.back());
+			m_MemberIndex[m_Members[index].UserId] = index;
 		}
+		m_Members.pop_back();
 	}
-	void UpdateMember(UserId_t userid, json const &data);
+	inline bool HasMember(UserId_t userid) const
+	{
+		return m_MemberIndex.count(userid) != 0;
+	}
+	// returns nullptr if the user isn't a cached member of this guild
+	Member *FindMember(UserId_t userid)
+	{
+		auto it = m_MemberIndex.find(userid);
+		return it != m_MemberIndex.end() ? &m_Members[it->second] : nullptr;
+	}
+	Member const *FindMember(UserId_t userid) const
+	{
+		auto it = m_MemberIndex.find(userid);
+		return it != m_MemberIndex.end() ? &m_Members[it->second] : nullptr;
+	}
+	Member *FindMemberById(Snowflake_t const &user_id);
+	void UpdateMember(UserId_t userid, gateway::GuildMemberUpdate const &data);
 	void UpdateMemberPresence(UserId_t userid, std::string const &status);	
 	void UpdateMemberVoiceChannel(UserId_t user_id, ChannelId_t const &channel);
 
-	inline void AddRole(RoleId_t id)
+	void AddRole(RoleId_t id);
+	void RemoveRole(RoleId_t id);
+	void UpdateRole(Role_t const &role, json const &data);
+	inline RoleId_t FindRoleByName(std::string const &name, bool case_sensitive = true) const
 	{
-		m_Roles.push_back(id);
+		return m_RoleNames.Find(name, case_sensitive);
 	}
-	inline void RemoveRole(RoleId_t id)
+	// returns INVALID_ROLE_SLOT if the role doesn't belong to this guild
+	inline int GetRoleSlot(RoleId_t id) const
 	{
-		for (auto it = m_Roles.begin(); it != m_Roles.end(); it++)
-		{
-			if (*it == id)
-			{
-				m_Roles.erase(it);
-				break;
-			}
-		}
+		auto it = m_RoleSlots.find(id);
+		return it != m_RoleSlots.end() ? static_cast<int>(it->second) : INVALID_ROLE_SLOT;
+	}
+	inline bool MemberHasRole(Member const &member, RoleId_t id) const
+	{
+		int const slot = GetRoleSlot(id);
+		return slot != INVALID_ROLE_SLOT && member.RoleSet.test(slot);
+	}
+
+	inline unsigned int GetStatusCount(Member::PresenceStatus status) const
+	{
+		return m_StatusCounts.at(static_cast<size_t>(status));
+	}
+	// members which are online, idle or in do-not-disturb mode
+	inline unsigned int GetOnlineCount() const
+	{
+		return GetStatusCount(Member::PresenceStatus::ONLINE)
+			+ GetStatusCount(Member::PresenceStatus::IDLE)
+			+ GetStatusCount(Member::PresenceStatus::DO_NOT_DISTURB);
+	}
+	// returns nullptr if nobody is connected to the channel
+	inline std::vector<UserId_t> const *GetVoiceChannelMembers(ChannelId_t channel) const
+	{
+		auto it = m_VoiceChannelMembers.find(channel);
+		return it != m_VoiceChannelMembers.end() ? &it->second : nullptr;
+	}
+
+	// appends the users of up to "max_count" members matching "filter"
+	void QueryMembers(MemberFilter const &filter, size_t max_count,
+		std::vector<UserId_t> &dest) const;
+
+	// effective permissions of a member in a channel of this guild, or
+	// guild-wide if "channelid" is INVALID_CHANNEL_ID; returns false if the
+	// user isn't a cached member or the channel isn't part of this guild
+	bool GetMemberPermissions(UserId_t userid, ChannelId_t channelid,
+		unsigned long long int &dest);
+	inline void InvalidateMemberPermissions()
+	{
+		m_PermissionCache.clear();
+	}
+	inline void InvalidateMemberPermissions(UserId_t userid)
+	{
+		m_PermissionCache.erase(userid);
 	}
 
 	void Update(json const &data);
@@ -163,7 +286,14 @@ public:
 	void KickMember(User_t const &user);
 	void CreateMemberBan(User_t const &user, std::string const &reason);
 	void RemoveMemberBan(User_t const &user);
-	const Member& FindMember(Snowflake_t const& member);
+
+	bool RequestMembers(std::vector<Snowflake_t> const &user_ids, pawn_cb::Callback_t &&callback);
+	bool SearchMembers(std::string const &query, unsigned int limit, pawn_cb::Callback_t &&callback);
+	// requests a member that isn't cached in lazy mode, returns false if it won't arrive
+	bool RequestMissingMember(UserId_t userid);
+	// "answered" is false if the request timed out or its connection was lost,
+	// the user is requested again on the next access then
+	void FinishMissingMemberRequest(UserId_t userid, bool answered);
 
 	void SetRolePosition(Role_t const &role, int position);
 	void SetRoleName(Role_t const &role, std::string const &name);
@@ -188,17 +318,53 @@ private:
 		m_Initialized{ 0 };
 	std::atomic<bool> m_IsInitialized{ false };
 
-	std::map<GuildId_t, Guild_t> m_Guilds; //PAWN guild-id to actual guild map
+	SlotMap<GuildId_t, Guild, 0, 16> m_Guilds; //PAWN guild-id to actual guild map
+	std::unordered_map<Snowflake_t, GuildId_t> m_GuildIds; //snowflake to PAWN guild-id
 	RoleId_t m_CreatedRoleId = INVALID_ROLE_ID;
 
+	// guild member requests sent through the gateway, by nonce
+	struct MemberRequest
+	{
+		GuildId_t Guild;
+		pawn_cb::Callback_t Callback;
+		UserId_t MissingMember; // set for requests made by RequestMissingMember
+		std::vector<UserId_t> Members;
+		std::chrono::steady_clock::time_point Sent;
+	};
+	// Discord answers within a second, a request without an answer after
+	// this was lost or rejected
+	static const unsigned int MEMBER_REQUEST_TIMEOUT_SECONDS = 15;
+	bool m_LazyMemberLoading = false;
+	unsigned int m_MemberRequestCount = 0;
+	std::unordered_map<std::string, MemberRequest> m_MemberRequests;
+	std::vector<UserId_t> m_RequestedMembers;
+
 private:
 	GuildId_t AddGuild(json const &data);
 	void DeleteGuild(Guild_t const &guild);
+	void HandleMemberRequestChunk(std::string const &nonce,
+		std::vector<UserId_t> &&members, bool last_chunk);
+	void FinishMemberRequest(std::string const &nonce, bool answered);
+	// completes the requests sent before "time" with what arrived so far
+	void FailMemberRequests(std::chrono::steady_clock::time_point time);
 
 public:
-	void Initialize();
+	void Initialize(bool lazy_member_loading = false);
 	bool IsInitialized();
 
+	bool IsLazyMemberLoading() const
+	{
+		return m_LazyMemberLoading;
+	}
+	std::string AddMemberRequest(GuildId_t guild, pawn_cb::Callback_t &&callback,
+		UserId_t missing_member = INVALID_USER_ID);
+	// completes requests which weren't answered in time, called every server tick
+	void ExpireMemberRequests();
+	std::vector<UserId_t> const &GetRequestedMembers() const
+	{
+		return m_RequestedMembers;
+	}
+
 	bool CreateGuildRole(Guild_t const &guild,
 		std::string const &name, pawn_cb::Callback_t &&callback);
 	RoleId_t GetCreatedRoleChannelId() const
@@ -210,9 +376,9 @@ public:
 	std::vector<GuildId_t> const GetGuilds()
 	{
 		std::vector<GuildId_t> tmp;
-		for (const auto& i : m_Guilds)
+		for (Guild_t const &guild : m_Guilds)
 		{
-			tmp.push_back(i.first);
+			tmp.push_back(guild->GetPawnId());
 		}
 		return tmp;
 	}
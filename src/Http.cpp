@@ -6,24 +6,33 @@
 #include <boost/asio/system_timer.hpp>
 #include <boost/beast/version.hpp>
 
-Http::Http(std::string token) :
+#include <future>
+
+Http::Http(asio::io_context &io_context, std::string token) :
+	m_Strand(asio::make_strand(io_context)),
+	m_QueueTimer(m_Strand),
+	m_ReconnectTimer(m_Strand),
+	m_Resolver(m_Strand),
 	m_SslContext(asio::ssl::context::tlsv12_client),
 	m_Token(token),
-	m_NetworkThreadRunning(true),
-	m_NetworkThread(std::bind(&Http::NetworkThreadFunc, this))
+	m_Running(true)
 {
-
+	// the connection is established with the first request
+	asio::post(m_Strand, [this]()
+	{
+		ProcessQueue({});
+	});
 }
 
 Http::~Http()
 {
-	m_NetworkThreadRunning = false;
-	m_NetworkThread.join();
-
 	// drain requests queue
 	QueueEntry *entry;
 	while (m_Queue.pop(entry))
 		delete entry;
+	for (auto e : m_SkippedEntries)
+		delete e;
+	delete m_CurrentEntry;
 }
 
 void Http::AddBucketIdentifierFromURL(std::string url, std::string bucket)
@@ -71,176 +80,310 @@ std::string const Http::GetBucketIdentifierFromURL(std::string url)
 	return "INVALID";
 }
 
-void Http::NetworkThreadFunc()
+void Http::Stop()
 {
-	unsigned int retry_counter = 0;
-	unsigned int const MaxRetries = 3;
-	bool skip_entry = false;
-	std::unordered_map<std::string, TimePoint_t> bucket_ratelimit;
+	if (!m_Running.exchange(false))
+		return;
+
+	std::promise<void> stopped;
+	asio::post(m_Strand, [this, &stopped]()
+	{
+		m_OnStopped = [&stopped]()
+		{
+			stopped.set_value();
+		};
+		m_QueueTimer.cancel();
+		m_ReconnectTimer.cancel();
+		m_Resolver.cancel();
+
+		// a running pass shuts down once its current request is done
+		if (!m_Busy)
+			Shutdown();
+	});
+	stopped.get_future().wait();
+}
 
-	if (!Connect())
+void Http::ProcessQueue(beast::error_code ec)
+{
+	if (ec || !m_Running)
 		return;
 
-	while (m_NetworkThreadRunning)
+	m_Busy = true;
+	m_PassTime = std::chrono::steady_clock::now();
+	SendNext();
+}
+
+// sends the next request which isn't rate-limited, ends the pass once the
+// queue is empty
+void Http::SendNext()
+{
+	if (!m_Running)
 	{
-		TimePoint_t current_time = std::chrono::steady_clock::now();
-		std::list<QueueEntry*> skipped_entries;
-		QueueEntry *entry;
-		while (m_Queue.pop(entry))
+		FinishPass();
+		return;
+	}
+
+	QueueEntry *entry;
+	while (m_Queue.pop(entry))
+	{
+		// check if we're rate-limited
+		std::string bucket = GetBucketIdentifierFromURL(entry->Request->target().to_string());
+		auto pr_it = m_BucketRateLimit.find(bucket);
+		if (pr_it != m_BucketRateLimit.end() && bucket != "INVALID")
 		{
-			// check if we're rate-limited
-			std::string bucket = GetBucketIdentifierFromURL(entry->Request->target().to_string());
-			auto pr_it = bucket_ratelimit.find(bucket);
-			if (pr_it != bucket_ratelimit.end() && bucket != "INVALID")
+			// rate-limit for this bucket exists
+			// are we still within the rate-limit timepoint?
+			if (m_PassTime < pr_it->second)
 			{
-				// rate-limit for this bucket exists
-				// are we still within the rate-limit timepoint?
-				if (current_time < pr_it->second)
-				{
-					// yes, ignore this request for now
-					skipped_entries.push_back(entry);
-					continue;
-				}
-
-				// no, delete rate-limit and go on
-				bucket_ratelimit.erase(pr_it);
-				Logger::Get()->Log(samplog_LogLevel::DEBUG, "rate-limit on bucket '{}' lifted",
-					entry->Request->target().to_string());
+				// yes, ignore this request for now
+				m_SkippedEntries.push_back(entry);
+				continue;
 			}
 
-			boost::system::error_code error_code;
-			Response_t response;
-			Streambuf_t sb;
-			retry_counter = 0;
-			skip_entry = false;
-			do
+			// no, delete rate-limit and go on
+			m_BucketRateLimit.erase(pr_it);
+			Logger::Get()->Log(samplog_LogLevel::DEBUG, "rate-limit on bucket '{}' lifted",
+				entry->Request->target().to_string());
+		}
+
+		m_CurrentEntry = entry;
+		m_RetryCounter = 0;
+		Send();
+		return;
+	}
+
+	FinishPass();
+}
+
+void Http::FinishPass()
+{
+	// add skipped entries back to queue
+	for (auto e : m_SkippedEntries)
+		m_Queue.push(e);
+	m_SkippedEntries.clear();
+	m_Busy = false;
+
+	if (!m_Running)
+	{
+		// if Stop() didn't get to the strand yet, it shuts down by itself
+		if (m_OnStopped)
+			Shutdown();
+		return;
+	}
+
+	m_QueueTimer.expires_after(std::chrono::milliseconds(50));
+	m_QueueTimer.async_wait(
+		beast::bind_front_handler(
+			&Http::ProcessQueue,
+			this));
+}
+
+void Http::Send()
+{
+	if (!m_Connected)
+	{
+		m_ReconnectCounter = 0;
+		Reconnect();
+		return;
+	}
+
+	m_Response = Response_t();
+	m_Buffer.consume(m_Buffer.size());
+
+	beast::get_lowest_layer(*m_SslStream).expires_after(std::chrono::seconds(30));
+	beast::http::async_write(*m_SslStream, *m_CurrentEntry->Request,
+		beast::bind_front_handler(
+			&Http::OnWrite,
+			this));
+}
+
+void Http::OnWrite(beast::error_code ec, std::size_t bytes_transferred)
+{
+	boost::ignore_unused(bytes_transferred);
+
+	if (ec)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR, "Error while sending HTTP {} request to '{}': {}",
+			m_CurrentEntry->Request->method_string().to_string(),
+			m_CurrentEntry->Request->target().to_string(),
+			ec.message());
+
+		Retry();
+		return;
+	}
+
+	beast::get_lowest_layer(*m_SslStream).expires_after(std::chrono::seconds(30));
+	beast::http::async_read(*m_SslStream, m_Buffer, m_Response,
+		beast::bind_front_handler(
+			&Http::OnRead,
+			this));
+}
+
+void Http::OnRead(beast::error_code ec, std::size_t bytes_transferred)
+{
+	boost::ignore_unused(bytes_transferred);
+
+	if (ec)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR, "Error while retrieving HTTP {} response from '{}': {}",
+			m_CurrentEntry->Request->method_string().to_string(),
+			m_CurrentEntry->Request->target().to_string(),
+			ec.message());
+
+		Retry();
+		return;
+	}
+
+	if (m_Response.result_int() == 429 /* rate limited */)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR, "Got a 429 from path '{}' (bucket '{}') this should not happen.",
+			m_CurrentEntry->Request->target().to_string(),
+			GetBucketIdentifierFromURL(m_CurrentEntry->Request->target().to_string()));
+	}
+
+	HandleResponse();
+	SendNext();
+}
+
+void Http::HandleResponse()
+{
+	QueueEntry *entry = m_CurrentEntry;
+	m_CurrentEntry = nullptr;
+	Response_t &response = m_Response;
+
+	auto it_r = response.find("X-RateLimit-Remaining");
+	if (it_r != response.end())
+	{
+		auto bucket_identifier = response.find("X-RateLimit-Bucket");
+		if (bucket_identifier != response.end())
+		{
+			if (bucket_urls.find(bucket_identifier->value().to_string()) == bucket_urls.end())
 			{
-				bool do_reconnect = false;
-				beast::http::write(*m_SslStream, *entry->Request, error_code);
-				if (error_code)
-				{
-					Logger::Get()->Log(samplog_LogLevel::ERROR, "Error while sending HTTP {} request to '{}': {}",
-						entry->Request->method_string().to_string(),
-						entry->Request->target().to_string(),
-						error_code.message());
+				//Logger::Get()->Log(samplog_LogLevel::ERROR, "{}", entry->Request->target().to_string());
+				AddBucketIdentifierFromURL(entry->Request->target().to_string(), bucket_identifier->value().to_string());
+			}
+		}
 
-					do_reconnect = true;
-				}
-				else
-				{
-					beast::http::read(*m_SslStream, sb, response, error_code);
-					if (error_code)
-					{
-						Logger::Get()->Log(samplog_LogLevel::ERROR, "Error while retrieving HTTP {} response from '{}': {}",
-							entry->Request->method_string().to_string(),
-							entry->Request->target().to_string(),
-							error_code.message());
-
-						do_reconnect = true;
-					}
-					else if (response.result_int() == 429 /* rate limited */)
-					{
-						Logger::Get()->Log(samplog_LogLevel::ERROR, "Got a 429 from path '{}' (bucket '{}') this should not happen.",
-							entry->Request->target().to_string(), GetBucketIdentifierFromURL(entry->Request->target().to_string()));
-					}
-				}
+		std::string const bucket = GetBucketIdentifierFromURL(entry->Request->target().to_string());
+		if (it_r->value().compare("0") == 0)
+		{
+			// we're now officially rate-limited
+			// the next call to this path will fail
+			auto lit = m_BucketRateLimit.find(bucket);
+			if (lit != m_BucketRateLimit.end())
+			{
+				Logger::Get()->Log(samplog_LogLevel::ERROR,
+					"Error while processing rate-limit: already rate-limited bucket '{}'",
+					bucket);
 
-				if (do_reconnect)
-				{
-					if (retry_counter++ >= MaxRetries || !ReconnectRetry())
-					{
-						// we failed to reconnect, discard this request
-						Logger::Get()->Log(samplog_LogLevel::WARNING, "Failed to send request, discarding");
-						skip_entry = true;
-						break; // break out of do-while loop
-					}
-				}
-			} while (error_code);
-			if (skip_entry)
-				continue; // continue queue loop
+				// skip this request, we'll re-add it to the queue to retry later
+				m_SkippedEntries.push_back(entry);
+				return;
+			}
 
-			auto it_r = response.find("X-RateLimit-Remaining");
+			it_r = response.find("X-RateLimit-Reset-After");
 			if (it_r != response.end())
 			{
-				auto bucket_identifier = response.find("X-RateLimit-Bucket");
-				if (bucket_identifier != response.end())
-				{
-					if (bucket_urls.find(bucket_identifier->value().to_string()) == bucket_urls.end())
-					{
-						//Logger::Get()->Log(samplog_LogLevel::ERROR, "{}", entry->Request->target().to_string());
-						AddBucketIdentifierFromURL(entry->Request->target().to_string(), bucket_identifier->value().to_string());
-					}
-				}
+				string const& reset_time_str = it_r->value().to_string();
+				long long reset_time_secs = 0;
+				ConvertStrToData(reset_time_str, reset_time_secs);
+				std::chrono::milliseconds milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::seconds(reset_time_secs));
 
-				bucket = GetBucketIdentifierFromURL(entry->Request->target().to_string());
-				if (it_r->value().compare("0") == 0)
+				// we have milliseconds too.
+				if (reset_time_str.find(".") != std::string::npos)
 				{
-					// we're now officially rate-limited
-					// the next call to this path will fail
-					auto lit = bucket_ratelimit.find(bucket);
-					if (lit != bucket_ratelimit.end())
-					{
-						Logger::Get()->Log(samplog_LogLevel::ERROR,
-							"Error while processing rate-limit: already rate-limited bucket '{}'",
-							bucket);
-
-						// skip this request, we'll re-add it to the queue to retry later
-						skipped_entries.push_back(entry);
-						continue;
-					}
-
-					it_r = response.find("X-RateLimit-Reset-After");
-					if (it_r != response.end())
-					{
-						string const& reset_time_str = it_r->value().to_string();
-						long long reset_time_secs = 0;
-						ConvertStrToData(reset_time_str, reset_time_secs);
-						std::chrono::milliseconds milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::seconds(reset_time_secs));
-
-						// we have milliseconds too.
-						if (reset_time_str.find(".") != std::string::npos)
-						{
-							const std::string msstr = reset_time_str.substr(reset_time_str.find(".")+1);
-							long ms;
-							ConvertStrToData(msstr, ms);
-							milliseconds += std::chrono::milliseconds(ms);
-						}
-
-						std::chrono::milliseconds timepoint_now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-						Logger::Get()->Log(samplog_LogLevel::DEBUG, "rate-limiting bucket {} until {} (current time: {})",
-							bucket,
-							it_r->value().to_string(),
-							timepoint_now.count());
-						TimePoint_t reset_time = std::chrono::steady_clock::now()
-							+ std::chrono::milliseconds(milliseconds.count() + 250); // add a buffer of 250 ms
-
-						bucket_ratelimit.insert({ bucket, reset_time });
-					}
+					const std::string msstr = reset_time_str.substr(reset_time_str.find(".")+1);
+					long ms;
+					ConvertStrToData(msstr, ms);
+					milliseconds += std::chrono::milliseconds(ms);
 				}
-			}
 
-			if (entry->Callback)
-				entry->Callback(sb, response);
+				std::chrono::milliseconds timepoint_now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+				Logger::Get()->Log(samplog_LogLevel::DEBUG, "rate-limiting bucket {} until {} (current time: {})",
+					bucket,
+					it_r->value().to_string(),
+					timepoint_now.count());
+				TimePoint_t reset_time = std::chrono::steady_clock::now()
+					+ std::chrono::milliseconds(milliseconds.count() + 250); // add a buffer of 250 ms
 
-			delete entry;
-			entry = nullptr;
+				m_BucketRateLimit.insert({ bucket, reset_time });
+			}
 		}
+	}
 
-		// add skipped entries back to queue
-		for (auto e : skipped_entries)
-			m_Queue.push(e);
+	if (entry->Callback)
+		entry->Callback(m_Buffer, response);
+
+	delete entry;
+}
+
+// reconnects and sends the current request again, gives up on it after
+// MAX_RETRIES attempts
+void Http::Retry()
+{
+	if (m_RetryCounter++ >= MAX_RETRIES || !m_Running)
+	{
+		Discard();
+		return;
+	}
+
+	m_ReconnectCounter = 0;
+	Reconnect();
+}
+
+void Http::Reconnect()
+{
+	Logger::Get()->Log(samplog_LogLevel::INFO, "trying reconnect #{}...", m_ReconnectCounter + 1);
+
+	CloseConnection();
+	Connect(std::bind(&Http::OnReconnect, this, std::placeholders::_1));
+}
+
+void Http::OnReconnect(bool success)
+{
+	if (success)
+	{
+		Logger::Get()->Log(samplog_LogLevel::INFO, "reconnect succeeded, resending request");
+		Send();
+		return;
+	}
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	if (++m_ReconnectCounter >= MAX_RECONNECTS || !m_Running)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR, "Could not reconnect to Discord");
+		Discard();
+		return;
 	}
 
-	Disconnect();
+	// back off on the strand's timer instead of sleeping on a pool thread
+	unsigned int seconds_to_wait = 1U << (m_ReconnectCounter - 1);
+	Logger::Get()->Log(samplog_LogLevel::WARNING, "reconnect failed, waiting {} seconds...", seconds_to_wait);
+	m_ReconnectTimer.expires_after(std::chrono::seconds(seconds_to_wait));
+	m_ReconnectTimer.async_wait([this](beast::error_code ec)
+	{
+		if (ec || !m_Running)
+		{
+			Discard();
+			return;
+		}
+		Reconnect();
+	});
+}
+
+void Http::Discard()
+{
+	Logger::Get()->Log(samplog_LogLevel::WARNING, "Failed to send request, discarding");
+
+	delete m_CurrentEntry;
+	m_CurrentEntry = nullptr;
+	SendNext();
 }
 
-bool Http::Connect()
+void Http::Connect(ConnectCallback_t &&callback)
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Http::Connect");
 
-	m_SslStream.reset(new SslStream_t(m_IoService, m_SslContext));
+	m_SslStream.reset(new SslStream_t(m_Strand, m_SslContext));
 
 	const char *API_HOST = "discord.com";
 
@@ -253,79 +396,88 @@ bool Http::Connect()
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
 			"Can't set SNI hostname for Discord API URL: {} ({})",
 			ec.message(), ec.value());
-		return false;
+		callback(false);
+		return;
 	}
 
 	// connect to REST API
-	asio::ip::tcp::resolver r{ m_IoService };
-	boost::system::error_code error;
-	auto target = r.resolve(API_HOST, "443", error);
-	if (error)
+	m_Resolver.async_resolve(API_HOST, "443", [this, callback](
+		beast::error_code ec, asio::ip::tcp::resolver::results_type results)
 	{
-		Logger::Get()->Log(samplog_LogLevel::ERROR, "Can't resolve Discord API URL: {} ({})",
-			error.message(), error.value());
-		return false;
-	}
+		if (ec)
+		{
+			Logger::Get()->Log(samplog_LogLevel::ERROR, "Can't resolve Discord API URL: {} ({})",
+				ec.message(), ec.value());
+			callback(false);
+			return;
+		}
 
-	beast::get_lowest_layer(*m_SslStream).expires_after(std::chrono::seconds(30));
-	beast::get_lowest_layer(*m_SslStream).connect(target, error);
-	if (error)
-	{
-		Logger::Get()->Log(samplog_LogLevel::ERROR, "Can't connect to Discord API: {} ({})",
-			error.message(), error.value());
-		return false;
-	}
+		beast::get_lowest_layer(*m_SslStream).expires_after(std::chrono::seconds(30));
+		beast::get_lowest_layer(*m_SslStream).async_connect(results, [this, callback](
+			beast::error_code ec, asio::ip::tcp::resolver::results_type::endpoint_type)
+		{
+			if (ec)
+			{
+				Logger::Get()->Log(samplog_LogLevel::ERROR, "Can't connect to Discord API: {} ({})",
+					ec.message(), ec.value());
+				callback(false);
+				return;
+			}
 
-	// SSL handshake
-	m_SslStream->handshake(asio::ssl::stream_base::client, error);
-	if (error)
-	{
-		Logger::Get()->Log(samplog_LogLevel::ERROR, "Can't establish secured connection to Discord API: {} ({})",
-			error.message(), error.value());
-		return false;
-	}
+			// SSL handshake
+			beast::get_lowest_layer(*m_SslStream).expires_after(std::chrono::seconds(30));
+			m_SslStream->async_handshake(asio::ssl::stream_base::client, [this, callback](
+				beast::error_code ec)
+			{
+				if (ec)
+				{
+					Logger::Get()->Log(samplog_LogLevel::ERROR,
+						"Can't establish secured connection to Discord API: {} ({})",
+						ec.message(), ec.value());
+					callback(false);
+					return;
+				}
 
-	return true;
+				m_Connected = true;
+				callback(true);
+			});
+		});
+	});
 }
 
-void Http::Disconnect()
+void Http::CloseConnection()
 {
-	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Http::Disconnect");
+	m_Connected = false;
+	if (!m_SslStream)
+		return;
 
-	boost::system::error_code error;
-	m_SslStream->shutdown(error);
-	if (error && error != boost::asio::error::eof && error != boost::asio::ssl::error::stream_truncated)
-	{
-		Logger::Get()->Log(samplog_LogLevel::WARNING, "Error while shutting down SSL on HTTP connection: {} ({})",
-			error.message(), error.value());
-	}
+	beast::error_code error;
+	beast::get_lowest_layer(*m_SslStream).socket().close(error);
 }
 
-bool Http::ReconnectRetry()
+// closes the connection and signals Stop(), called on the strand once the
+// current pass is done
+void Http::Shutdown()
 {
-	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Http::ReconnectRetry");
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Http::Shutdown");
 
-	unsigned int reconnect_counter = 0;
-	do
+	if (!m_Connected)
 	{
-		Logger::Get()->Log(samplog_LogLevel::INFO, "trying reconnect #{}...", reconnect_counter + 1);
+		m_OnStopped();
+		return;
+	}
 
-		Disconnect();
-		if (Connect())
-		{
-			Logger::Get()->Log(samplog_LogLevel::INFO, "reconnect succeeded, resending request");
-			return true;
-		}
-		else
+	m_Connected = false;
+	beast::get_lowest_layer(*m_SslStream).expires_after(std::chrono::seconds(5));
+	m_SslStream->async_shutdown([this](beast::error_code error)
+	{
+		if (error && error != boost::asio::error::eof && error != boost::asio::ssl::error::stream_truncated)
 		{
-			unsigned int seconds_to_wait = static_cast<unsigned int>(std::pow(2U, reconnect_counter));
-			Logger::Get()->Log(samplog_LogLevel::WARNING, "reconnect failed, waiting {} seconds...", seconds_to_wait);
-			std::this_thread::sleep_for(std::chrono::seconds(seconds_to_wait));
+			Logger::Get()->Log(samplog_LogLevel::WARNING, "Error while shutting down SSL on HTTP connection: {} ({})",
+				error.message(), error.value());
 		}
-	} while (++reconnect_counter < 3);
-
-	Logger::Get()->Log(samplog_LogLevel::ERROR, "Could not reconnect to Discord");
-	return false;
+		m_OnStopped();
+	});
 }
 
 Http::SharedRequest_t Http::PrepareRequest(beast::http::verb const method,
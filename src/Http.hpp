@@ -7,11 +7,13 @@
 #include <thread>
 #include <atomic>
 #include <map>
+#include <list>
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/lockfree/queue.hpp>
 
 #ifdef DELETE
@@ -36,7 +38,7 @@ public:
 	using ResponseCb_t = std::function<void(Response)>;
 
 public:
-	Http(std::string token);
+	Http(asio::io_context &io_context, std::string token);
 	~Http();
 
 private:
@@ -59,8 +61,19 @@ private:
 		ResponseCallback_t Callback;
 	};
 
+	using ConnectCallback_t = std::function<void(bool)>;
+
+	static const unsigned int
+		MAX_RETRIES = 3, // per request
+		MAX_RECONNECTS = 3; // per retry
+
 private:
-	asio::io_context m_IoService;
+	// requests are sent one after another on the strand, every step is an
+	// asynchronous operation so no handler blocks a thread of the shared pool
+	asio::strand<asio::io_context::executor_type> m_Strand;
+	asio::steady_timer m_QueueTimer;
+	asio::steady_timer m_ReconnectTimer;
+	asio::ip::tcp::resolver m_Resolver;
 	asio::ssl::context m_SslContext;
 	using SslStream_t = beast::ssl_stream<beast::tcp_stream>;
 	std::unique_ptr<SslStream_t> m_SslStream;
@@ -72,18 +85,40 @@ private:
 		boost::lockfree::fixed_sized<true>,
 		boost::lockfree::capacity<8192>
 	> m_Queue;
-	std::atomic<bool> m_NetworkThreadRunning;
-	std::thread m_NetworkThread;
+	std::atomic<bool> m_Running;
+	bool m_Connected = false;
+
+	// state of the current queue pass, only accessed on the strand
+	bool m_Busy = false; // a pass is running, the queue timer isn't armed
+	TimePoint_t m_PassTime;
+	std::list<QueueEntry *> m_SkippedEntries;
+	QueueEntry *m_CurrentEntry = nullptr;
+	Response_t m_Response;
+	Streambuf_t m_Buffer;
+	unsigned int m_RetryCounter = 0;
+	unsigned int m_ReconnectCounter = 0;
+	std::function<void()> m_OnStopped;
 	std::map<std::string, std::string> bucket_urls;
+	std::unordered_map<std::string, TimePoint_t> m_BucketRateLimit;
 
 private: // functions
 	void AddBucketIdentifierFromURL(std::string url, std::string bucket);
 	std::string const GetBucketIdentifierFromURL(std::string url);
-	void NetworkThreadFunc();
-
-	bool Connect();
-	void Disconnect();
-	bool ReconnectRetry();
+	void ProcessQueue(beast::error_code ec);
+	void SendNext();
+	void FinishPass();
+	void Send();
+	void OnWrite(beast::error_code ec, std::size_t bytes_transferred);
+	void OnRead(beast::error_code ec, std::size_t bytes_transferred);
+	void HandleResponse();
+	void Retry();
+	void Reconnect();
+	void OnReconnect(bool success);
+	void Discard();
+
+	void Connect(ConnectCallback_t &&callback);
+	void CloseConnection();
+	void Shutdown();
 
 	SharedRequest_t PrepareRequest(beast::http::verb const method,
 		std::string const &url, std::string const &content, bool use_api = true);
@@ -92,6 +127,10 @@ private: // functions
 	ResponseCallback_t CreateResponseCallback(ResponseCb_t &&callback);
 
 public: // functions
+	// waits for the request that is currently sent and closes the
+	// connection, has to be called while the io_context is still running
+	void Stop();
+
 	void Get(std::string const &url, ResponseCb_t &&callback, bool use_api = true);
 	void Post(std::string const &url, std::string const &content,
 		ResponseCb_t &&callback = nullptr);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+
+// Hands out the PAWN ids of cached entities. Freed ids are kept on a stack
+// and handed out again before the id space grows, so allocating and freeing
+// are both O(1).
+// With GENERATION_BITS > 0 the upper bits of an id hold a counter which is
+// bumped every time its slot is freed; a stale id a script kept around after
+// the entity was deleted then doesn't match the new entity in the same slot.
+// Ids always start at 1 and stay positive, so 0 remains the invalid id.
+template<typename Id_t, unsigned int GENERATION_BITS = 0>
+class IdAllocator
+{
+	static_assert(GENERATION_BITS < 24, "IdAllocator needs enough bits left for the slot index");
+
+public:
+	static const unsigned int INDEX_BITS = 31 - GENERATION_BITS;
+	static const uint32_t INDEX_MASK = (uint32_t{ 1 } << INDEX_BITS) - 1;
+	static const uint32_t GENERATION_MASK = (uint32_t{ 1 } << GENERATION_BITS) - 1;
+
+public:
+	// returns 0 if the id space is exhausted
+	Id_t Allocate()
+	{
+		uint32_t index;
+		if (!m_FreeIndices.empty())
+		{
+			index = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+		}
+		else
+		{
+			if (m_NextIndex > INDEX_MASK)
+				return 0;
+			index = m_NextIndex++;
+		}
+		return MakeId(index);
+	}
+
+	void Free(Id_t id)
+	{
+		uint32_t const index = GetIndex(id);
+		if (index == 0 || index >= m_NextIndex)
+			return;
+
+		if (GENERATION_BITS != 0)
+		{
+			uint32_t &generation = m_Generations[index];
+			if ((static_cast<uint32_t>(id) >> INDEX_BITS) != generation)
+				return; // stale id, the slot was already freed
+			generation = (generation + 1) & GENERATION_MASK;
+		}
+		m_FreeIndices.push_back(index);
+	}
+
+	// slot index of an id, without the generation bits
+	static uint32_t GetIndex(Id_t id)
+	{
+		return static_cast<uint32_t>(id) & INDEX_MASK;
+	}
+
+	void Clear()
+	{
+		m_NextIndex = 1;
+		m_FreeIndices.clear();
+		m_Generations.clear();
+	}
+
+private:
+	uint32_t m_NextIndex = 1;
+	std::vector<uint32_t> m_FreeIndices;
+	std::vector<uint32_t> m_Generations; // only used with GENERATION_BITS > 0
+
+private:
+	Id_t MakeId(uint32_t index)
+	{
+		if (GENERATION_BITS == 0)
+			return static_cast<Id_t>(index);
+
+		if (index >= m_Generations.size())
+			m_Generations.resize(index + 1, 0);
+		return static_cast<Id_t>(index | (m_Generations[index] << INDEX_BITS));
+	}
+};
@@ -0,0 +1,140 @@
+#include "Intents.hpp"
+#include "Logger.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+
+
+bool Intents::Parse(std::string const &str, int &dest)
+{
+	if (str.empty() || str == "auto")
+	{
+		dest = AUTO;
+		return true;
+	}
+
+	try
+	{
+		dest = std::stoi(str);
+	}
+	catch (...)
+	{
+		return false;
+	}
+	return true;
+}
+
+bool Intents::ReadScriptSymbols(std::string const &path,
+	std::unordered_set<std::string> &dest)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::vector<char> const data(
+		(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	// see AMX_HEADER in amx.h; all fields are little-endian
+	auto read_int = [&data](size_t offset, size_t size) -> int64_t
+	{
+		int64_t value = 0;
+		for (size_t i = 0; i != size; ++i)
+			value |= static_cast<int64_t>(static_cast<uint8_t>(data[offset + i])) << (i * 8);
+		return value;
+	};
+
+	size_t const
+		HEADER_SIZE = 56,
+		MAGIC_OFFSET = 4,
+		DEFSIZE_OFFSET = 10,
+		PUBLICS_OFFSET = 32,
+		LIBRARIES_OFFSET = 40;
+	uint16_t const AMX_MAGIC_32 = 0xF1E0;
+
+	if (data.size() < HEADER_SIZE || read_int(MAGIC_OFFSET, 2) != AMX_MAGIC_32)
+		return false;
+
+	// only the name table format (AMX_FUNCSTUBNT) is supported
+	size_t const defsize = static_cast<size_t>(read_int(DEFSIZE_OFFSET, 2));
+	if (defsize != 8)
+		return false;
+
+	// the natives table directly follows the publics table
+	size_t const
+		publics_begin = static_cast<size_t>(read_int(PUBLICS_OFFSET, 4)),
+		tables_end = static_cast<size_t>(read_int(LIBRARIES_OFFSET, 4));
+	if (publics_begin > tables_end || tables_end > data.size())
+		return false;
+
+	for (size_t entry = publics_begin; entry + defsize <= tables_end; entry += defsize)
+	{
+		size_t const name_offset = static_cast<size_t>(read_int(entry + 4, 4));
+		if (name_offset >= data.size())
+			return false;
+
+		char const *name = data.data() + name_offset;
+		dest.emplace(name, strnlen(name, data.size() - name_offset));
+	}
+	return true;
+}
+
+int Intents::Resolve(int subscribed, std::vector<std::string> const &script_files)
+{
+	// intents that are only needed if some script can observe their events
+	static const struct
+	{
+		int intents;
+		std::vector<const char *> symbols;
+	} optional_intents[] = {
+		{ GUILD_PRESENCES, {
+			"DCC_OnGuildMemberUpdate",
+			"DCC_GetGuildMemberStatus",
+			"DCC_GetGuildOnlineCount",
+			"DCC_QueryGuildMembers" } },
+		{ GUILD_VOICE_STATES, {
+			"DCC_OnGuildMemberVoiceUpdate",
+			"DCC_GetGuildMemberVoiceChannel",
+			"DCC_GetVoiceChannelMembers",
+			"DCC_QueryGuildMembers" } },
+		{ GUILD_MESSAGES | DIRECT_MESSAGES | MESSAGE_CONTENT, {
+			"DCC_OnMessageCreate",
+			"DCC_OnMessageDelete" } },
+		{ GUILD_MESSAGE_REACTIONS | DIRECT_MESSAGE_REACTIONS, {
+			"DCC_OnMessageReaction" } },
+	};
+
+	std::unordered_set<std::string> symbols;
+	bool found_script = false;
+	for (auto const &path : script_files)
+	{
+		if (ReadScriptSymbols(path, symbols))
+			found_script = true;
+		else
+			Logger::Get()->Log(samplog_LogLevel::WARNING,
+				"can't inspect script '{}' for required gateway intents", path);
+	}
+
+	if (!found_script)
+		return subscribed;
+
+	int intents = subscribed;
+	for (auto const &opt : optional_intents)
+	{
+		bool used = false;
+		for (auto const *symbol : opt.symbols)
+		{
+			if (symbols.find(symbol) != symbols.end())
+			{
+				used = true;
+				break;
+			}
+		}
+
+		if (!used)
+			intents &= ~opt.intents;
+	}
+
+	return intents;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+
+class Intents
+{
+public:
+	enum Flag : int
+	{
+		GUILDS = 1 << 0,
+		GUILD_MEMBERS = 1 << 1,
+		GUILD_MODERATION = 1 << 2,
+		GUILD_EMOJIS_AND_STICKERS = 1 << 3,
+		GUILD_INTEGRATIONS = 1 << 4,
+		GUILD_WEBHOOKS = 1 << 5,
+		GUILD_INVITES = 1 << 6,
+		GUILD_VOICE_STATES = 1 << 7,
+		GUILD_PRESENCES = 1 << 8,
+		GUILD_MESSAGES = 1 << 9,
+		GUILD_MESSAGE_REACTIONS = 1 << 10,
+		GUILD_MESSAGE_TYPING = 1 << 11,
+		DIRECT_MESSAGES = 1 << 12,
+		DIRECT_MESSAGE_REACTIONS = 1 << 13,
+		DIRECT_MESSAGE_TYPING = 1 << 14,
+		MESSAGE_CONTENT = 1 << 15,
+		GUILD_SCHEDULED_EVENTS = 1 << 16,
+		AUTO_MODERATION_CONFIGURATION = 1 << 20,
+		AUTO_MODERATION_EXECUTION = 1 << 21,
+	};
+
+	static const int ALL = 131071;
+	// derive the intents from the subscribed events and the loaded scripts
+	static const int AUTO = 0;
+
+public:
+	// Removes intents from 'subscribed' that only feed Pawn callbacks or
+	// natives which none of the script files make use of.
+	// If none of the script files can be read, 'subscribed' is returned as is.
+	static int Resolve(int subscribed, std::vector<std::string> const &script_files);
+
+	static bool Parse(std::string const &str, int &dest);
+
+private:
+	// collects the names of all publics and natives of a compiled script
+	static bool ReadScriptSymbols(std::string const &path,
+		std::unordered_set<std::string> &dest);
+};
@@ -0,0 +1,110 @@
+#include "JsonWriter.hpp"
+
+
+namespace
+{
+	// returns the length of the well-formed UTF-8 sequence starting at "str",
+	// or 0 if it is malformed (overlong, surrogate, out of range, truncated)
+	size_t GetUtf8SequenceLength(const unsigned char *str, size_t available)
+	{
+		auto const is_cont = [str, available](size_t i,
+			unsigned char lo = 0x80, unsigned char hi = 0xBF)
+		{
+			return i < available && str[i] >= lo && str[i] <= hi;
+		};
+
+		unsigned char const lead = str[0];
+		if (lead >= 0xC2 && lead <= 0xDF)
+			return is_cont(1) ? 2 : 0;
+		if (lead == 0xE0)
+			return is_cont(1, 0xA0) && is_cont(2) ? 3 : 0;
+		if (lead == 0xED)
+			return is_cont(1, 0x80, 0x9F) && is_cont(2) ? 3 : 0;
+		if (lead >= 0xE1 && lead <= 0xEF)
+			return is_cont(1) && is_cont(2) ? 3 : 0;
+		if (lead == 0xF0)
+			return is_cont(1, 0x90) && is_cont(2) && is_cont(3) ? 4 : 0;
+		if (lead >= 0xF1 && lead <= 0xF3)
+			return is_cont(1) && is_cont(2) && is_cont(3) ? 4 : 0;
+		if (lead == 0xF4)
+			return is_cont(1, 0x80, 0x8F) && is_cont(2) && is_cont(3) ? 4 : 0;
+		return 0;
+	}
+}
+
+std::string &JsonWriter::ThreadBuffer()
+{
+	thread_local std::string buffer;
+	return buffer;
+}
+
+void JsonWriter::WriteString(fmt::string_view str)
+{
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+
+	auto const *it = reinterpret_cast<const unsigned char *>(str.data());
+	auto const *end = it + str.size();
+	auto const *run = it; // start of the bytes which can be copied as-is
+
+	m_Dest.push_back('"');
+	while (it != end)
+	{
+		unsigned char const c = *it;
+		if (c < 0x80 && c >= 0x20 && c != '"' && c != '\\')
+		{
+			++it;
+			continue;
+		}
+		if (c >= 0x80)
+		{
+			size_t const length = GetUtf8SequenceLength(it, end - it);
+			if (length != 0)
+			{
+				it += length;
+				continue;
+			}
+		}
+
+		m_Dest.append(reinterpret_cast<const char *>(run), it - run);
+		switch (c)
+		{
+		case '"':
+			m_Dest.append("\\\"");
+			break;
+		case '\\':
+			m_Dest.append("\\\\");
+			break;
+		case '\b':
+			m_Dest.append("\\b");
+			break;
+		case '\f':
+			m_Dest.append("\\f");
+			break;
+		case '\n':
+			m_Dest.append("\\n");
+			break;
+		case '\r':
+			m_Dest.append("\\r");
+			break;
+		case '\t':
+			m_Dest.append("\\t");
+			break;
+		default:
+			if (c < 0x20)
+			{
+				m_Dest.append("\\u00");
+				m_Dest.push_back(HEX_DIGITS[c >> 4]);
+				m_Dest.push_back(HEX_DIGITS[c & 0xF]);
+			}
+			else
+			{
+				// invalid UTF-8, Discord would reject the whole payload
+				m_Dest.append("\xEF\xBF\xBD"); // U+FFFD
+			}
+			break;
+		}
+		run = ++it;
+	}
+	m_Dest.append(reinterpret_cast<const char *>(run), it - run);
+	m_Dest.push_back('"');
+}
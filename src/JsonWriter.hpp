@@ -0,0 +1,189 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cassert>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+#include "Snowflake.hpp"
+
+
+// Streams JSON text straight into a string without building a DOM first.
+// Commas between members/elements are inserted automatically, the caller is
+// responsible for balancing the Begin*/End* calls.
+// The destination string is cleared but keeps its capacity, so a reused
+// string doesn't allocate once it has grown to the usual payload size.
+class JsonWriter
+{
+public:
+	explicit JsonWriter(std::string &dest) :
+		m_Dest(dest)
+	{
+		m_Dest.clear();
+	}
+	~JsonWriter() = default;
+
+	JsonWriter(JsonWriter const &rhs) = delete;
+	JsonWriter &operator=(JsonWriter const &rhs) = delete;
+
+	// per-thread scratch buffer for payloads which get copied anyway
+	// (e.g. HTTP request bodies)
+	static std::string &ThreadBuffer();
+
+public:
+	JsonWriter &BeginObject()
+	{
+		BeginValue();
+		m_Dest.push_back('{');
+		Push();
+		return *this;
+	}
+	JsonWriter &BeginObject(fmt::string_view key)
+	{
+		return Key(key).BeginObject();
+	}
+	JsonWriter &EndObject()
+	{
+		Pop();
+		m_Dest.push_back('}');
+		return *this;
+	}
+
+	JsonWriter &BeginArray()
+	{
+		BeginValue();
+		m_Dest.push_back('[');
+		Push();
+		return *this;
+	}
+	JsonWriter &BeginArray(fmt::string_view key)
+	{
+		return Key(key).BeginArray();
+	}
+	JsonWriter &EndArray()
+	{
+		Pop();
+		m_Dest.push_back(']');
+		return *this;
+	}
+
+	JsonWriter &Key(fmt::string_view key)
+	{
+		assert(!m_AfterKey && m_Depth > 0);
+		BeginValue();
+		WriteString(key);
+		m_Dest.push_back(':');
+		m_AfterKey = true;
+		return *this;
+	}
+
+	JsonWriter &String(fmt::string_view value)
+	{
+		BeginValue();
+		WriteString(value);
+		return *this;
+	}
+	JsonWriter &String(fmt::string_view key, fmt::string_view value)
+	{
+		return Key(key).String(value);
+	}
+
+	// snowflakes are sent as strings, invalid ones as null
+	JsonWriter &Id(Snowflake const &value)
+	{
+		BeginValue();
+		if (!value.IsValid())
+		{
+			m_Dest.append("null");
+			return *this;
+		}
+		fmt::format_int const str(value.Value());
+		m_Dest.push_back('"');
+		m_Dest.append(str.data(), str.size());
+		m_Dest.push_back('"');
+		return *this;
+	}
+	JsonWriter &Id(fmt::string_view key, Snowflake const &value)
+	{
+		return Key(key).Id(value);
+	}
+
+	template<typename T>
+	JsonWriter &Int(T value)
+	{
+		static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value,
+			"JsonWriter::Int requires an integral type");
+		BeginValue();
+		fmt::format_int const str(value);
+		m_Dest.append(str.data(), str.size());
+		return *this;
+	}
+	template<typename T>
+	JsonWriter &Int(fmt::string_view key, T value)
+	{
+		return Key(key).Int(value);
+	}
+
+	JsonWriter &Bool(bool value)
+	{
+		BeginValue();
+		m_Dest.append(value ? "true" : "false");
+		return *this;
+	}
+	JsonWriter &Bool(fmt::string_view key, bool value)
+	{
+		return Key(key).Bool(value);
+	}
+
+	JsonWriter &Null()
+	{
+		BeginValue();
+		m_Dest.append("null");
+		return *this;
+	}
+	JsonWriter &Null(fmt::string_view key)
+	{
+		return Key(key).Null();
+	}
+
+private:
+	std::string &m_Dest;
+
+	// bit N is set when nesting level N+1 already holds a value
+	uint64_t m_HasValue = 0;
+	unsigned int m_Depth = 0;
+	bool m_AfterKey = false;
+
+private:
+	void BeginValue()
+	{
+		if (m_AfterKey)
+		{
+			m_AfterKey = false;
+			return;
+		}
+		if (m_Depth == 0)
+			return;
+
+		uint64_t const bit = uint64_t{ 1 } << (m_Depth - 1);
+		if (m_HasValue & bit)
+			m_Dest.push_back(',');
+		else
+			m_HasValue |= bit;
+	}
+	void Push()
+	{
+		assert(m_Depth < 64);
+		m_HasValue &= ~(uint64_t{ 1 } << m_Depth);
+		++m_Depth;
+	}
+	void Pop()
+	{
+		assert(m_Depth > 0 && !m_AfterKey);
+		--m_Depth;
+	}
+
+	void WriteString(fmt::string_view str);
+};
@@ -9,29 +9,22 @@
 #include "utils.hpp"
 #include "Emoji.hpp"
 #include "Embed.hpp"
+#include "JsonWriter.hpp"
 
-Message::Message(MessageId_t pawn_id, json const &data) : m_PawnId(pawn_id)
-{
-	std::string author_id, channel_id, guild_id;
-	_valid =
-		utils::TryGetJsonValue(data, m_Id, "id") &&
-		utils::TryGetJsonValue(data, author_id, "author", "id") &&
-		utils::TryGetJsonValue(data, channel_id, "channel_id") &&
-		utils::TryGetJsonValue(data, m_Content, "content") &&
-		utils::TryGetJsonValue(data, m_IsTts, "tts") &&
-		utils::TryGetJsonValue(data, m_MentionsEveryone, "mention_everyone");
-
-	if (!_valid)
-	{
-		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't construct message object: invalid JSON: \"{}\"", data.dump());
-		return;
-	}
+#include <algorithm>
 
-	Channel_t const &channel = ChannelManager::Get()->FindChannelById(channel_id);
-	if (!channel && !utils::TryGetJsonValue(data, guild_id, "guild_id"))
+Message::Message(MessageId_t pawn_id, gateway::Message const &data) :
+	m_Id(data.Id),
+	m_PawnId(pawn_id),
+	m_Content(data.Content),
+	m_IsTts(data.IsTts),
+	m_MentionsEveryone(data.MentionsEveryone),
+	_valid(true)
+{
+	Channel_t const &channel = ChannelManager::Get()->FindChannelById(data.ChannelId);
+	if (!channel && !data.GuildId.IsValid())
 	{
-		ChannelId_t cid = ChannelManager::Get()->AddDMChannel(data);
+		ChannelId_t cid = ChannelManager::Get()->AddDMChannel(data.ChannelId);
 		m_Channel = ChannelManager::Get()->FindChannel(cid)->GetPawnId();
 	}
 	else
@@ -39,35 +32,21 @@ Message::Message(MessageId_t pawn_id, json const &data) : m_PawnId(pawn_id)
 		m_Channel = channel ? channel->GetPawnId() : INVALID_CHANNEL_ID;
 	}
 
-	User_t const &user = UserManager::Get()->FindUserById(author_id);
+	User_t const &user = UserManager::Get()->FindUserById(data.AuthorId);
 	m_Author = user ? user->GetPawnId() : INVALID_USER_ID;
 
-	if (utils::IsValidJson(data, "mentions", json::value_t::array))
+	for (auto const &mu_id : data.UserMentions)
 	{
-		for (auto &c : data["mentions"])
-		{
-			std::string mu_id;
-			if (!utils::TryGetJsonValue(c, mu_id, "id"))
-				continue;
-
-			User_t const &mu = UserManager::Get()->FindUserById(mu_id);
-			if (mu)
-				m_UserMentions.push_back(mu->GetPawnId());
-		}
+		User_t const &mu = UserManager::Get()->FindUserById(mu_id);
+		if (mu)
+			m_UserMentions.push_back(mu->GetPawnId());
 	}
 
-	if (utils::IsValidJson(data, "mention_roles", json::value_t::array))
+	for (auto const &mr_id : data.RoleMentions)
 	{
-		for (auto &c : data["mention_roles"])
-		{
-			std::string mr_id;
-			if (!utils::TryGetJsonValue(c, mr_id, "id"))
-				continue;
-
-			Role_t const &mr = RoleManager::Get()->FindRoleById(mr_id);
-			if (mr)
-				m_RoleMentions.push_back(mr->GetPawnId());
-		}
+		Role_t const &mr = RoleManager::Get()->FindRoleById(mr_id);
+		if (mr)
+			m_RoleMentions.push_back(mr->GetPawnId());
 	}
 }
 
@@ -89,9 +68,9 @@ void Message::AddReaction(Emoji_t const& emoji)
 
 	std::string emoji_str = emoji->GetName();
 
-	if (emoji->GetSnowflake() != "")
+	if (emoji->GetSnowflake().IsValid())
 	{
-		emoji_str += ":" + emoji->GetSnowflake();
+		emoji_str += ":" + emoji->GetSnowflake().ToString();
 	}
 	else
 	{
@@ -127,7 +106,7 @@ bool Message::DeleteReaction(EmojiId_t const emojiid)
 			return false;
 		}
 
-		if (emoji->GetSnowflake() != "")
+		if (emoji->GetSnowflake().IsValid())
 		{
 			// custom emoji
 			url += fmt::format("/{:s}:{:s}", emoji->GetName(), emoji->GetSnowflake());
@@ -155,9 +134,10 @@ bool Message::EditMessage(const std::string& msg, const EmbedId_t embedid)
 	if (!channel)
 		return false;
 
-	json data = {
-		{ "content", msg }
-	};
+	auto &json_str = JsonWriter::ThreadBuffer();
+	JsonWriter writer(json_str);
+	writer.BeginObject()
+		.String("content", msg);
 
 	if (embedid != INVALID_EMBED_ID)
 	{
@@ -168,59 +148,11 @@ bool Message::EditMessage(const std::string& msg, const EmbedId_t embedid)
 			return false;
 		}
 
-		data["embed"] =
-		{
-			{ "title", embed->GetTitle() },
-			{ "description", embed->GetDescription() },
-			{ "url", embed->GetUrl() },
-			{ "timestamp", embed->GetTimestamp() },
-			{ "color", embed->GetColor() },
-			{ "footer", {
-				{"text", embed->GetFooterText()},
-				//{"icon_url", embed->GetFooterIconUrl()},
-			}},
-			{"thumbnail", {
-				//{"url", embed->GetThumbnailUrl()}
-			}},
-			{"image", {
-				//{"url", embed->GetImageUrl()}
-			}}
-		};
-
-		if (!embed->GetThumbnailUrl().empty())
-		{
-			data["embed"]["thumbnail"] += {"url", embed->GetThumbnailUrl()};
-		}
-
-		if (!embed->GetFooterIconUrl().empty())
-		{
-			data["embed"]["footer"] += {"icon_url", embed->GetFooterIconUrl()};
-		}
-
-		if (!embed->GetImageUrl().empty())
-		{
-			data["embed"]["image"] += {"url", embed->GetImageUrl()};
-		}
-
-		if (embed->GetFields().size())
-		{
-			json field_array = json::array();
-			for (const auto& i : embed->GetFields())
-			{
-				field_array.push_back({
-					{"name", i._name},
-					{"value", i._value},
-					{"inline", i._inline_}
-					});
-			}
-			data["embed"]["fields"] = field_array;
-		}
+		writer.Key("embed");
+		embed->Serialize(writer);
 		EmbedManager::Get()->DeleteEmbed(embedid);
 	}
-
-	std::string json_str;
-	if (!utils::TryDumpJson(data, json_str))
-		Logger::Get()->Log(samplog_LogLevel::ERROR, "can't serialize JSON: {}", json_str);
+	writer.EndObject();
 
 	Network::Get()->Http().Patch(fmt::format("/channels/{:s}/messages/{:s}", channel->GetId(), GetId()), json_str);
 	return true;
@@ -229,9 +161,18 @@ bool Message::EditMessage(const std::string& msg, const EmbedId_t embedid)
 void MessageManager::Initialize()
 {
 	// PAWN callbacks
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::MESSAGE_CREATE, [](json const &data)
+	Network::Get()->WebSocket().RegisterRawEvent(WebSocket::Event::MESSAGE_CREATE,
+		[](const char *payload, size_t length)
 	{
-		PawnDispatcher::Get()->Dispatch([data]() mutable
+		gateway::Message data;
+		if (!gateway::Decode(payload, length, data))
+		{
+			Logger::Get()->Log(samplog_LogLevel::ERROR,
+				"invalid JSON: expected \"id\", \"channel_id\" and \"author.id\" in MESSAGE_CREATE event");
+			return;
+		}
+
+		PawnDispatcher::Get()->Dispatch([data = std::move(data)]() mutable
 		{
 			MessageId_t msg = MessageManager::Get()->Create(data);
 			if (msg != INVALID_MESSAGE_ID)
@@ -296,7 +237,7 @@ void MessageManager::Initialize()
 		});
 	});
 
-	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::MESSAGE_REACTION_REMOVE, [](json const& data)
+	Network::Get()->WebSocket().RegisterEvent(WebSocket::Event::MESSAGE_REACTION_REMOVE, [](json &&data)
 	{
 		Snowflake_t user_id, message_id, emoji_id;
 		std::string name;
@@ -310,7 +251,7 @@ void MessageManager::Initialize()
 			return;
 		utils::TryGetJsonValue(data, emoji_id, "emoji", "id");
 
-		PawnDispatcher::Get()->Dispatch([data, user_id, message_id, emoji_id, name]() mutable
+		PawnDispatcher::Get()->Dispatch([data = std::move(data), user_id, message_id, emoji_id, name]() mutable
 		{
 			auto const& msg = MessageManager::Get()->FindById(message_id);
 			auto const& user = UserManager::Get()->FindUserById(user_id);
@@ -370,18 +311,19 @@ void MessageManager::Initialize()
 	});
 }
 
-MessageId_t MessageManager::Create(json const &data)
+MessageId_t MessageManager::Create(gateway::Message const &data)
 {
-	MessageId_t id = 1;
-	while (m_Messages.find(id) != m_Messages.end())
-		++id;
-
-	if (!m_Messages.emplace(id, Message_t(new Message(id, data))).first->second)
+	MessageId_t id = m_Messages.Emplace([&](void *storage, MessageId_t pawn_id)
+	{
+		return new (storage) Message(pawn_id, data);
+	});
+	if (id == INVALID_MESSAGE_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create message: duplicate key '{}'", id);
-		return INVALID_USER_ID;
+			"can't create message: out of message ids");
+		return INVALID_MESSAGE_ID;
 	}
+	m_MessageIds[data.Id].push_back(id);
 
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "created message with id '{}'", id);
 	return id;
@@ -389,11 +331,19 @@ MessageId_t MessageManager::Create(json const &data)
 
 bool MessageManager::Delete(MessageId_t id)
 {
-	auto it = m_Messages.find(id);
-	if (it == m_Messages.end())
+	Message_t const &msg = m_Messages.Find(id);
+	if (!msg)
 		return false;
 
-	m_Messages.erase(it);
+	auto index_it = m_MessageIds.find(msg->GetId());
+	if (index_it != m_MessageIds.end())
+	{
+		auto &ids = index_it->second;
+		ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+		if (ids.empty())
+			m_MessageIds.erase(index_it);
+	}
+	m_Messages.Erase(id);
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "deleted message with id '{}'", id);
 	return true;
 }
@@ -406,9 +356,11 @@ void MessageManager::CreateFromSnowflake(Snowflake_t channel, Snowflake_t messag
 			Logger::Get()->Log(samplog_LogLevel::DEBUG,
 				"message fetch response: status {}; body: {}; add: {}",
 				r.status, r.body, r.additional_data);
-			if (r.status / 100 == 2) // success
+			gateway::Message data;
+			if (r.status / 100 == 2 // success
+				&& gateway::DecodeMessage(r.body, data))
 			{
-				const auto & message_id = Create(json::parse(r.body));
+				const auto & message_id = Create(data);
 				if (callback)
 				{
 					PawnDispatcher::Get()->Dispatch([this, message_id, callback]() mutable
@@ -432,21 +384,14 @@ void MessageManager::CreateFromSnowflake(Snowflake_t channel, Snowflake_t messag
 
 Message_t const &MessageManager::Find(MessageId_t id)
 {
-	static Message_t invalid_msg;
-	auto it = m_Messages.find(id);
-	if (it == m_Messages.end())
-		return invalid_msg;
-	return it->second;
+	return m_Messages.Find(id);
 }
 
 Message_t const &MessageManager::FindById(Snowflake_t const &sfid)
 {
 	static Message_t invalid_msg;
-	for (auto const &u : m_Messages)
-	{
-		auto const &msg = u.second;
-		if (msg->GetId().compare(sfid) == 0)
-			return msg;
-	}
-	return invalid_msg;
+	auto it = m_MessageIds.find(sfid);
+	if (it == m_MessageIds.end())
+		return invalid_msg;
+	return Find(it->second.front());
 }
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "types.hpp"
+#include "SlotMap.hpp"
 #include "Singleton.hpp"
 #include "PawnDispatcher.hpp"
 #include "Callback.hpp"
+#include "GatewayEvents.hpp"
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 #include <json.hpp>
 
@@ -19,7 +22,7 @@ class Message
 private:
 	Message() : _valid(false)
 	{ }
-	Message(MessageId_t pawn_id, json const &data);
+	Message(MessageId_t pawn_id, gateway::Message const &data);
 public:
 	~Message() = default;
 
@@ -115,7 +118,15 @@ private:
 	~MessageManager() = default;
 
 private:
-	std::map<MessageId_t, Message_t> m_Messages; //PAWN message-id to actual channel map
+	// messages are created and deleted all the time and scripts tend to keep
+	// their ids around, so ids carry a generation to tell stale ones apart
+	static const unsigned int MESSAGE_ID_GENERATION_BITS = 8;
+
+	SlotMap<MessageId_t, Message, MESSAGE_ID_GENERATION_BITS> m_Messages; //PAWN message-id to actual channel map
+	// snowflake to PAWN message-ids; the same message can be created more
+	// than once (e.g. by a send response and by MESSAGE_CREATE), lookups
+	// return the oldest instance still alive
+	std::unordered_map<Snowflake_t, std::vector<MessageId_t>> m_MessageIds;
 
 	MessageId_t m_CreatedMessageId = INVALID_MESSAGE_ID;
 
@@ -131,7 +142,7 @@ public:
 		m_CreatedMessageId = id;
 	}
 
-	MessageId_t Create(json const &data);
+	MessageId_t Create(gateway::Message const &data);
 	bool Delete(MessageId_t id);
 
 	// This is for the cache.
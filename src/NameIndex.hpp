@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+
+// Maps names to the PAWN ids of the entities carrying them. Names aren't
+// unique, so every name holds all its ids in ascending order and lookups
+// return the lowest one.
+// Besides the exact names, a normalized variant (ASCII case folded, leading
+// and trailing whitespace removed) is kept for case-insensitive lookups.
+template<typename Id_t>
+class NameIndex
+{
+public:
+	void Add(std::string const &name, Id_t id)
+	{
+		Insert(m_Exact, name, id);
+		Insert(m_Normalized, Normalize(name), id);
+	}
+	void Remove(std::string const &name, Id_t id)
+	{
+		Erase(m_Exact, name, id);
+		Erase(m_Normalized, Normalize(name), id);
+	}
+	void Rename(std::string const &old_name, std::string const &new_name, Id_t id)
+	{
+		if (old_name == new_name)
+			return;
+
+		Remove(old_name, id);
+		Add(new_name, id);
+	}
+
+	// returns 0 if there's no entity with that name
+	Id_t Find(std::string const &name, bool case_sensitive = true) const
+	{
+		return case_sensitive
+			? Lookup(m_Exact, name)
+			: Lookup(m_Normalized, Normalize(name));
+	}
+
+	static std::string Normalize(std::string const &name)
+	{
+		auto const is_space = [](char c)
+		{
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+		};
+
+		size_t begin = 0, end = name.size();
+		while (begin != end && is_space(name[begin]))
+			++begin;
+		while (end != begin && is_space(name[end - 1]))
+			--end;
+
+		std::string normalized(name, begin, end - begin);
+		for (char &c : normalized)
+		{
+			if (c >= 'A' && c <= 'Z')
+				c = static_cast<char>(c - 'A' + 'a');
+		}
+		return normalized;
+	}
+
+private:
+	using Map_t = std::unordered_map<std::string, std::vector<Id_t>>;
+
+	Map_t
+		m_Exact,
+		m_Normalized;
+
+private:
+	static void Insert(Map_t &map, std::string const &name, Id_t id)
+	{
+		auto &ids = map[name];
+		auto it = std::lower_bound(ids.begin(), ids.end(), id);
+		if (it == ids.end() || *it != id)
+			ids.insert(it, id);
+	}
+	static void Erase(Map_t &map, std::string const &name, Id_t id)
+	{
+		auto map_it = map.find(name);
+		if (map_it == map.end())
+			return;
+
+		auto &ids = map_it->second;
+		auto it = std::lower_bound(ids.begin(), ids.end(), id);
+		if (it != ids.end() && *it == id)
+			ids.erase(it);
+		if (ids.empty())
+			map.erase(map_it);
+	}
+	static Id_t Lookup(Map_t const &map, std::string const &name)
+	{
+		auto it = map.find(name);
+		return it != map.end() ? it->second.front() : Id_t();
+	}
+};
@@ -1,12 +1,38 @@
 #include "Network.hpp"
 #include "Logger.hpp"
+#include "SessionState.hpp"
 
 
+Network::Network() :
+	m_WorkGuard(asio::make_work_guard(m_IoContext))
+{
+	m_WebSocket = std::unique_ptr<::WebSocket>(new ::WebSocket(m_IoContext));
+}
+
+void Network::Start(unsigned int thread_count)
+{
+	if (!m_Threads.empty())
+		return;
+
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Network::Start({:d})", thread_count);
+
+	if (thread_count == 0)
+		thread_count = 1;
+
+	for (unsigned int i = 0; i != thread_count; ++i)
+	{
+		m_Threads.emplace_back([this]()
+		{
+			m_IoContext.run();
+		});
+	}
+}
+
 void Network::Initialize(std::string const &token, int intents)
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Network::Initialize");
 
-	m_Http = std::unique_ptr<::Http>(new ::Http(token));
+	m_Http = std::unique_ptr<::Http>(new ::Http(m_IoContext, token));
 
 	// retrieve WebSocket host URL
 	m_Http->Get("/gateway", [this, token, intents](Http::Response res)
@@ -30,9 +56,36 @@ void Network::Initialize(std::string const &token, int intents)
 
 }
 
+void Network::Resume(std::string const &token, int intents, SessionState &&state)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Network::Resume");
+
+	m_Http = std::unique_ptr<::Http>(new ::Http(m_IoContext, token));
+	m_WebSocket->Resume(token, intents, std::move(state));
+}
+
+void Network::Replay(std::string const &token, std::string const &file, double speed)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Network::Replay");
+
+	// REST requests made by scripts still go to Discord
+	m_Http = std::unique_ptr<::Http>(new ::Http(m_IoContext, token));
+	m_WebSocket->Replay(file, speed);
+}
+
 Network::~Network()
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "Network::~Network");
+
+	// the connections can only be closed properly while the threads still run
+	m_WebSocket->Stop();
+	if (m_Http)
+		m_Http->Stop();
+
+	m_WorkGuard.reset();
+	m_IoContext.stop();
+	for (auto &t : m_Threads)
+		t.join();
 }
 
 ::Http &Network::Http()
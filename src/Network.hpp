@@ -4,6 +4,11 @@
 
 #include <string>
 #include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/executor_work_guard.hpp>
 
 #include "Http.hpp"
 #include "WebSocket.hpp"
@@ -12,19 +17,30 @@
 class Network : public Singleton<Network>
 {
 	friend class Singleton<Network>;
+public:
+	static const unsigned int DEFAULT_THREAD_COUNT = 2;
+
 private:
-	Network()
-	{
-		m_WebSocket = std::unique_ptr<::WebSocket>(new ::WebSocket());
-	}
+	Network();
 	~Network();
 
 private: // variables
+	// all network components run on this io_context, each on its own strand
+	asio::io_context m_IoContext;
+	asio::executor_work_guard<asio::io_context::executor_type> m_WorkGuard;
+	std::vector<std::thread> m_Threads;
+
 	std::unique_ptr<::Http> m_Http;
 	std::unique_ptr<::WebSocket> m_WebSocket;
 
 public: // functions
+	// starts the threads running the io_context, has to be called before
+	// connecting; only the first call has an effect
+	void Start(unsigned int thread_count);
+
 	void Initialize(std::string const &token, int intents);
+	void Resume(std::string const &token, int intents, SessionState &&state);
+	void Replay(std::string const &token, std::string const &file, double speed);
 
 	::Http &Http();
 	::WebSocket &WebSocket();
@@ -1,10 +1,55 @@
 #include "PawnDispatcher.hpp"
+#include "Logger.hpp"
+
+#include <iterator>
 
 
 void PawnDispatcher::Dispatch(Function_t &&func)
 {
 	std::lock_guard<std::mutex> lock_guard(m_QueueMtx);
-	return m_Queue.push(std::move(func));
+	m_Queue.push_back({ std::move(func), std::string() });
+	UpdateSaturation();
+}
+
+void PawnDispatcher::DispatchCollapsible(std::string key, Function_t &&func)
+{
+	std::lock_guard<std::mutex> lock_guard(m_QueueMtx);
+
+	auto it = m_CollapsedTasks.find(key);
+	if (it != m_CollapsedTasks.end())
+	{
+		// the pending task is moved to the tail, otherwise the latest payload
+		// would run ahead of tasks dispatched after the first one
+		it->second->Func = std::move(func);
+		m_Queue.splice(m_Queue.end(), m_Queue, it->second);
+		return;
+	}
+
+	if (!m_Saturated)
+	{
+		m_Queue.push_back({ std::move(func), std::string() });
+	}
+	else
+	{
+		m_Queue.push_back({ std::move(func), key });
+		m_CollapsedTasks.emplace(std::move(key), std::prev(m_Queue.end()));
+	}
+	UpdateSaturation();
+}
+
+void PawnDispatcher::UpdateSaturation()
+{
+	if (m_Saturated)
+	{
+		if (m_Queue.size() <= LOW_WATERMARK)
+			m_Saturated = false;
+	}
+	else if (m_Queue.size() >= HIGH_WATERMARK)
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"Pawn dispatch queue is saturated ({:d} pending tasks)", m_Queue.size());
+		m_Saturated = true;
+	}
 }
 
 void PawnDispatcher::Process()
@@ -12,7 +57,18 @@ void PawnDispatcher::Process()
 	std::lock_guard<std::mutex> lock_guard(m_QueueMtx);
 	while (m_Queue.empty() == false)
 	{
-		m_Queue.front()();
-		m_Queue.pop();
+		Task task = std::move(m_Queue.front());
+		m_Queue.pop_front();
+		if (!task.Key.empty())
+			m_CollapsedTasks.erase(task.Key);
+		UpdateSaturation();
+
+		task.Func();
 	}
 }
+
+bool PawnDispatcher::HasPendingTasks()
+{
+	std::lock_guard<std::mutex> lock_guard(m_QueueMtx);
+	return !m_Queue.empty();
+}
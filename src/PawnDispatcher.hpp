@@ -2,9 +2,13 @@
 
 #include "Singleton.hpp"
 
-#include <queue>
+#include <list>
 #include <mutex>
-#include <functional>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 
 #include "types.hpp"
 
@@ -13,18 +17,90 @@ class PawnDispatcher : public Singleton<PawnDispatcher>
 {
 	friend class Singleton<PawnDispatcher>;
 public: //type definitions
-	using Function_t = std::function<void()>;
+	// like std::function<void()>, but move-only, so tasks can take over
+	// their payloads instead of having to copy them
+	class Function_t
+	{
+	public:
+		Function_t() = default;
+		template<typename F, typename = typename std::enable_if<
+			!std::is_same<typename std::decay<F>::type, Function_t>::value>::type>
+		Function_t(F &&func) :
+			m_Callable(new Callable<typename std::decay<F>::type>(std::forward<F>(func)))
+		{ }
+		Function_t(Function_t &&rhs) = default;
+		Function_t &operator=(Function_t &&rhs) = default;
+
+		explicit operator bool() const
+		{
+			return m_Callable != nullptr;
+		}
+		void operator()()
+		{
+			m_Callable->Invoke();
+		}
+
+	private:
+		struct CallableBase
+		{
+			virtual ~CallableBase() = default;
+			virtual void Invoke() = 0;
+		};
+		template<typename F>
+		struct Callable : CallableBase
+		{
+			template<typename U>
+			explicit Callable(U &&func) :
+				Func(std::forward<U>(func))
+			{ }
+			void Invoke() override
+			{
+				Func();
+			}
+			F Func;
+		};
+		std::unique_ptr<CallableBase> m_Callable;
+	};
+
+	// number of queued tasks at which the dispatcher counts as saturated,
+	// and at which it stops being saturated again
+	static const size_t
+		HIGH_WATERMARK = 10000,
+		LOW_WATERMARK = 1000;
 
 private: //constructor / destructor
 	PawnDispatcher() = default;
 	~PawnDispatcher() = default;
 
 private: //variables
-	std::queue<Function_t> m_Queue;
+	struct Task
+	{
+		Function_t Func;
+		std::string Key; // only set for collapsible tasks
+	};
+	using Queue_t = std::list<Task>;
+	Queue_t m_Queue;
+	// queue entries of collapsible tasks that are still pending, by key
+	std::unordered_map<std::string, Queue_t::iterator> m_CollapsedTasks;
 	std::mutex m_QueueMtx;
+	std::atomic<bool> m_Saturated{ false };
+
+private: //functions
+	void UpdateSaturation();
 
 public: //functions
 	void Dispatch(Function_t &&func);
+	// while saturated, replaces a still pending task with the same key instead
+	// of queueing another one; only use this for tasks where the latest one is enough.
+	// The replacing task takes the queue position of the latest call, so it
+	// still runs after everything dispatched before it.
+	void DispatchCollapsible(std::string key, Function_t &&func);
 	void Process();
+	bool HasPendingTasks();
+
+	bool IsSaturated() const
+	{
+		return m_Saturated;
+	}
 
 };
@@ -52,41 +52,37 @@ RoleId_t RoleManager::AddRole(json const &data)
 		return role->GetPawnId();
 	}
 
-	RoleId_t id = 1;
-	while (m_Roles.find(id) != m_Roles.end())
-		++id;
-
-	if (!m_Roles.emplace(id, Role_t(new Role(id, data))).first->second)
+	RoleId_t id = m_Roles.Emplace([&](void *storage, RoleId_t pawn_id)
+	{
+		return new (storage) Role(pawn_id, data);
+	});
+	if (id == INVALID_ROLE_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create role: duplicate key '{}'", id);
+			"can't create role: out of role ids");
 		return INVALID_ROLE_ID;
 	}
+	m_RoleIds.emplace(sfid, id);
 	return id;
 }
 
 void RoleManager::RemoveRole(Role_t const &role)
 {
-	m_Roles.erase(role->GetPawnId());
+	RoleId_t const id = role->GetPawnId();
+	m_RoleIds.erase(role->GetId());
+	m_Roles.Erase(id);
 }
 
 Role_t const &RoleManager::FindRole(RoleId_t id)
 {
-	static Role_t invalid_role;
-	auto it = m_Roles.find(id);
-	if (it == m_Roles.end())
-		return invalid_role;
-	return it->second;
+	return m_Roles.Find(id);
 }
 
 Role_t const &RoleManager::FindRoleById(Snowflake_t const &sfid)
 {
 	static Role_t invalid_role;
-	for (auto const &g : m_Roles)
-	{
-		Role_t const &role = g.second;
-		if (role->GetId().compare(sfid) == 0)
-			return role;
-	}
-	return invalid_role;
+	auto it = m_RoleIds.find(sfid);
+	if (it == m_RoleIds.end())
+		return invalid_role;
+	return FindRole(it->second);
 }
@@ -2,9 +2,11 @@
 
 #include "Singleton.hpp"
 #include "types.hpp"
+#include "SlotMap.hpp"
 
 #include <string>
 #include <atomic>
+#include <unordered_map>
 
 #include <json.hpp>
 
@@ -90,7 +92,8 @@ private:
 	const unsigned int m_InitValue = 1;
 	std::atomic<unsigned int> m_Initialized{ 0 };
 
-	std::map<RoleId_t, Role_t> m_Roles; //PAWN role-id to actual channel map
+	SlotMap<RoleId_t, Role> m_Roles; //PAWN role-id to actual channel map
+	std::unordered_map<Snowflake_t, RoleId_t> m_RoleIds; //snowflake to PAWN role-id
 
 public:
 	RoleId_t AddRole(json const &data);
@@ -0,0 +1,262 @@
+#include "SessionState.hpp"
+#include "Guild.hpp"
+#include "Channel.hpp"
+#include "User.hpp"
+#include "Role.hpp"
+#include "Logger.hpp"
+#include "utils.hpp"
+
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+
+const char *SessionState::FILE_PATH = "discord-connector.session";
+const unsigned int SessionState::FORMAT_VERSION;
+
+std::string SessionState::GetTokenHash(std::string const &token)
+{
+	return std::to_string(std::hash<std::string>()(token));
+}
+
+json GetUserJson(User_t const &user)
+{
+	return {
+		{ "id", user->GetId() },
+		{ "username", user->GetUsername() },
+		{ "discriminator", user->GetDiscriminator() },
+		{ "bot", user->IsBot() },
+		{ "verified", user->IsVerified() }
+	};
+}
+
+void SessionState::CaptureCache()
+{
+	Ready = {
+		{ "session_id", SessionId },
+		{ "resume_gateway_url", ResumeGatewayUrl },
+		{ "private_channels", json::array() },
+		{ "guilds", json::array() }
+	};
+
+	auto const &bot_user = UserManager::Get()->FindUser(
+		UserManager::Get()->GetBotUserId());
+	if (bot_user)
+		Ready["user"] = GetUserJson(bot_user);
+
+	Guilds.clear();
+	for (auto guild_id : GuildManager::Get()->GetGuilds())
+	{
+		auto const &guild = GuildManager::Get()->FindGuild(guild_id);
+		if (!guild)
+			continue;
+
+		json roles = json::array();
+		for (auto role_id : guild->GetRoles())
+		{
+			auto const &role = RoleManager::Get()->FindRole(role_id);
+			if (!role)
+				continue;
+
+			roles.push_back({
+				{ "id", role->GetId() },
+				{ "name", role->GetName() },
+				{ "color", role->GetColor() },
+				{ "hoist", role->IsHoist() },
+				{ "position", role->GetPosition() },
+				{ "permissions", std::to_string(role->GetPermissions()) },
+				{ "mentionable", role->IsMentionable() }
+			});
+		}
+
+		json channels = json::array();
+		for (auto channel_id : guild->GetChannels())
+		{
+			auto const &channel = ChannelManager::Get()->FindChannel(channel_id);
+			if (!channel)
+				continue;
+
+			json c = {
+				{ "id", channel->GetId() },
+				{ "type", static_cast<unsigned int>(channel->GetType()) },
+				{ "name", channel->GetName() },
+				{ "topic", channel->GetTopic() },
+				{ "position", channel->GetPosition() },
+				{ "nsfw", channel->IsNsfw() },
+				{ "parent_id", nullptr }
+			};
+
+			auto const &parent = ChannelManager::Get()->FindChannel(channel->GetParentId());
+			if (parent)
+				c["parent_id"] = parent->GetId();
+
+			json overwrites = json::array();
+			for (auto const &o : channel->GetPermissionOverwrites())
+			{
+				overwrites.push_back({
+					{ "id", o.Id },
+					{ "type", o.IsMember ? 1 : 0 },
+					{ "allow", std::to_string(o.Allow) },
+					{ "deny", std::to_string(o.Deny) }
+				});
+			}
+			c["permission_overwrites"] = std::move(overwrites);
+
+			channels.push_back(std::move(c));
+		}
+
+		static const char *status_names[] = {
+			nullptr, "online", "idle", "dnd", "offline"
+		};
+
+		json
+			members = json::array(),
+			presences = json::array(),
+			voice_states = json::array();
+		for (auto const &m : guild->GetMembers())
+		{
+			auto const &user = UserManager::Get()->FindUser(m.UserId);
+			if (!user)
+				continue;
+
+			json member_roles = json::array();
+			for (auto role_id : m.Roles)
+			{
+				auto const &role = RoleManager::Get()->FindRole(role_id);
+				if (role)
+					member_roles.push_back(role->GetId());
+			}
+
+			members.push_back({
+				{ "user", GetUserJson(user) },
+				{ "nick", m.Nickname.empty() ? json(nullptr) : json(m.Nickname) },
+				{ "roles", std::move(member_roles) }
+			});
+
+			auto const status = static_cast<size_t>(m.Status);
+			if (status > 0 && status < sizeof(status_names) / sizeof(status_names[0]))
+			{
+				presences.push_back({
+					{ "user", { { "id", user->GetId() } } },
+					{ "status", status_names[status] }
+				});
+			}
+
+			auto const &voice_channel = ChannelManager::Get()->FindChannel(m.VoiceChannel);
+			if (voice_channel)
+			{
+				voice_states.push_back({
+					{ "user_id", user->GetId() },
+					{ "channel_id", voice_channel->GetId() }
+				});
+			}
+		}
+
+		Ready["guilds"].push_back({
+			{ "id", guild->GetId() },
+			{ "unavailable", true }
+		});
+
+		Guilds.push_back({
+			{ "id", guild->GetId() },
+			{ "name", guild->GetName() },
+			{ "owner_id", guild->GetOwnerId() },
+			{ "member_count", members.size() },
+			{ "roles", std::move(roles) },
+			{ "channels", std::move(channels) },
+			{ "members", std::move(members) },
+			{ "presences", std::move(presences) },
+			{ "voice_states", std::move(voice_states) }
+		});
+	}
+}
+
+bool SessionState::Save() const
+{
+	auto const now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	json state = {
+		{ "format", FORMAT_VERSION },
+		{ "token_hash", TokenHash },
+		{ "intents", Intents },
+		{ "saved_at", now },
+		{ "session_id", SessionId },
+		{ "sequence", Sequence },
+		{ "resume_gateway_url", ResumeGatewayUrl },
+		{ "ready", Ready },
+		{ "guilds", Guilds }
+	};
+
+	std::ofstream file(FILE_PATH, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"can't write session state file '{}'", FILE_PATH);
+		return false;
+	}
+
+	file << state.dump();
+	return file.good();
+}
+
+bool SessionState::Load(std::string const &token, int intents)
+{
+	std::ifstream file(FILE_PATH, std::ios::binary);
+	if (!file)
+		return false;
+
+	json state = json::parse(file, nullptr, false);
+	file.close();
+	std::remove(FILE_PATH);
+
+	if (state.is_discarded() || !state.is_object())
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"can't parse session state file '{}'", FILE_PATH);
+		return false;
+	}
+
+	auto const now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	unsigned int format = 0;
+	if (!utils::TryGetJsonValue(state, format, "format") || format != FORMAT_VERSION)
+	{
+		Logger::Get()->Log(samplog_LogLevel::INFO,
+			"session state file '{}' was saved by another version, not resuming", FILE_PATH);
+		return false;
+	}
+
+	int64_t saved_at = 0;
+	if (!utils::TryGetJsonValue(state, TokenHash, "token_hash")
+		|| !utils::TryGetJsonValue(state, Intents, "intents")
+		|| !utils::TryGetJsonValue(state, saved_at, "saved_at")
+		|| !utils::TryGetJsonValue(state, SessionId, "session_id")
+		|| !utils::TryGetJsonValue(state, Sequence, "sequence")
+		|| !utils::TryGetJsonValue(state, ResumeGatewayUrl, "resume_gateway_url")
+		|| !utils::IsValidJson(state,
+			"ready", json::value_t::object,
+			"guilds", json::value_t::array))
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"invalid session state file '{}'", FILE_PATH);
+		return false;
+	}
+
+	// a resumed session keeps the intents it was identified with
+	if (TokenHash != GetTokenHash(token) || Intents != intents)
+		return false;
+
+	if (now - saved_at > RESUME_TIMEOUT_SECONDS || now < saved_at)
+	{
+		Logger::Get()->Log(samplog_LogLevel::INFO,
+			"saved gateway session is too old to be resumed");
+		return false;
+	}
+
+	Ready = std::move(state["ready"]);
+	Guilds = state["guilds"].get<std::vector<json>>();
+	return true;
+}
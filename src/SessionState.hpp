@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <json.hpp>
+
+
+using json = nlohmann::json;
+
+// Gateway session and a snapshot of the cache, saved when the plugin unloads
+// so that the next start can RESUME the session instead of identifying again.
+// The snapshot is replayed as READY and GUILD_CREATE events before resuming,
+// the gateway then only sends the events that were missed in between.
+class SessionState
+{
+public:
+	std::string TokenHash;
+	int Intents = 0;
+
+	std::string SessionId;
+	uint64_t Sequence = 0;
+	std::string ResumeGatewayUrl;
+
+	json Ready;
+	std::vector<json> Guilds;
+
+public:
+	// fills in the cache snapshot from the managers
+	void CaptureCache();
+
+	bool Save() const;
+	// only succeeds for a recent session of the same bot and intents;
+	// the state file is consumed either way
+	bool Load(std::string const &token, int intents);
+
+	static std::string GetTokenHash(std::string const &token);
+
+private:
+	static const char *FILE_PATH;
+	// bumped whenever the snapshot changes, older files aren't resumed
+	static const unsigned int FORMAT_VERSION = 2;
+	// how long Discord is expected to keep an abandoned session resumable
+	static const int64_t RESUME_TIMEOUT_SECONDS = 120;
+};
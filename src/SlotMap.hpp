@@ -0,0 +1,209 @@
+#pragma once
+
+#include "IdAllocator.hpp"
+
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <type_traits>
+#include <cstddef>
+
+
+// Owns the cached entities of a manager, addressed by their PAWN id.
+// Entities are constructed in place in fixed-size pages of slots, so they sit
+// next to each other in memory, are found by id with two array lookups and
+// never move once created (pages are only appended, never reallocated).
+// Lookups hand out a reference to the entity pointer of the slot, which is
+// reset to null when the entity is erased.
+template<typename Id_t, typename T, unsigned int GENERATION_BITS = 0, size_t PAGE_SIZE = 256>
+class SlotMap
+{
+public:
+	using Pointer_t = T *;
+
+private:
+	static_assert(PAGE_SIZE != 0 && (PAGE_SIZE & (PAGE_SIZE - 1)) == 0,
+		"SlotMap page size has to be a power of two");
+
+	struct Slot
+	{
+		Pointer_t Object = nullptr; // points to Storage while the slot is used
+		Id_t Id = 0;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+	};
+	using Page_t = std::unique_ptr<Slot[]>;
+
+public:
+	class const_iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Pointer_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Pointer_t const *;
+		using reference = Pointer_t const &;
+
+		const_iterator(std::vector<Page_t> const &pages, size_t index) :
+			m_Pages(&pages),
+			m_Index(index)
+		{
+			SkipUnused();
+		}
+
+		reference operator*() const
+		{
+			return GetSlot().Object;
+		}
+		const_iterator &operator++()
+		{
+			++m_Index;
+			SkipUnused();
+			return *this;
+		}
+		const_iterator operator++(int)
+		{
+			const_iterator tmp(*this);
+			++*this;
+			return tmp;
+		}
+		bool operator==(const_iterator const &rhs) const
+		{
+			return m_Index == rhs.m_Index;
+		}
+		bool operator!=(const_iterator const &rhs) const
+		{
+			return m_Index != rhs.m_Index;
+		}
+
+	private:
+		std::vector<Page_t> const *m_Pages;
+		size_t m_Index;
+
+		Slot const &GetSlot() const
+		{
+			return (*m_Pages)[m_Index / PAGE_SIZE][m_Index % PAGE_SIZE];
+		}
+		void SkipUnused()
+		{
+			size_t const end = m_Pages->size() * PAGE_SIZE;
+			while (m_Index < end && GetSlot().Object == nullptr)
+				++m_Index;
+		}
+	};
+
+public:
+	SlotMap() = default;
+	~SlotMap()
+	{
+		Clear();
+	}
+	SlotMap(SlotMap const &rhs) = delete;
+	SlotMap &operator=(SlotMap const &rhs) = delete;
+
+	// "construct" is called as construct(void *storage, Id_t id) and has to
+	// placement-new the entity into "storage"; this way entities with
+	// constructors only their manager can access can be stored as well.
+	// Returns 0 if the id space is exhausted.
+	template<typename Construct>
+	Id_t Emplace(Construct &&construct)
+	{
+		Id_t const id = m_IdAllocator.Allocate();
+		if (id == 0)
+			return 0;
+
+		size_t const index = IdAllocator<Id_t, GENERATION_BITS>::GetIndex(id);
+		while (m_Pages.size() <= index / PAGE_SIZE)
+			m_Pages.emplace_back(new Slot[PAGE_SIZE]);
+
+		Slot &slot = m_Pages[index / PAGE_SIZE][index % PAGE_SIZE];
+		try
+		{
+			// the entity isn't findable until it's fully constructed
+			Pointer_t object = construct(static_cast<void *>(&slot.Storage), id);
+			slot.Id = id;
+			slot.Object = object;
+		}
+		catch (...)
+		{
+			m_IdAllocator.Free(id);
+			throw;
+		}
+		++m_Size;
+		return id;
+	}
+
+	Pointer_t const &Find(Id_t id) const
+	{
+		static Pointer_t const invalid_object = nullptr;
+		Slot const *slot = GetSlot(id);
+		if (slot == nullptr || slot->Object == nullptr || slot->Id != id)
+			return invalid_object;
+		return slot->Object;
+	}
+
+	bool Erase(Id_t id)
+	{
+		Slot *slot = const_cast<Slot *>(GetSlot(id));
+		if (slot == nullptr || slot->Object == nullptr || slot->Id != id)
+			return false;
+
+		Pointer_t object = slot->Object;
+		slot->Object = nullptr;
+		object->~T();
+		m_IdAllocator.Free(id);
+		--m_Size;
+		return true;
+	}
+
+	void Clear()
+	{
+		for (Page_t &page : m_Pages)
+		{
+			for (size_t i = 0; i != PAGE_SIZE; ++i)
+			{
+				Slot &slot = page[i];
+				if (slot.Object == nullptr)
+					continue;
+
+				Pointer_t object = slot.Object;
+				slot.Object = nullptr;
+				object->~T();
+			}
+		}
+		m_Pages.clear();
+		m_IdAllocator.Clear();
+		m_Size = 0;
+	}
+
+	size_t Size() const
+	{
+		return m_Size;
+	}
+	bool Empty() const
+	{
+		return m_Size == 0;
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(m_Pages, 0);
+	}
+	const_iterator end() const
+	{
+		return const_iterator(m_Pages, m_Pages.size() * PAGE_SIZE);
+	}
+
+private:
+	std::vector<Page_t> m_Pages;
+	IdAllocator<Id_t, GENERATION_BITS> m_IdAllocator;
+	size_t m_Size = 0;
+
+private:
+	Slot const *GetSlot(Id_t id) const
+	{
+		size_t const index = IdAllocator<Id_t, GENERATION_BITS>::GetIndex(id);
+		if (index == 0 || index / PAGE_SIZE >= m_Pages.size())
+			return nullptr;
+		return &m_Pages[index / PAGE_SIZE][index % PAGE_SIZE];
+	}
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+
+#include <fmt/format.h>
+#include <json.hpp>
+
+
+// Discord ids are 64-bit integers, but they're sent as strings. They are
+// parsed once when they come in (JSON payloads, Pawn) and only formatted
+// again when they leave (URLs, outgoing payloads, Pawn).
+// A snowflake of zero is invalid and formats as an empty string.
+class Snowflake
+{
+public:
+	Snowflake() = default;
+	explicit Snowflake(uint64_t value) :
+		m_Value(value)
+	{ }
+	// strings which aren't a valid id result in an invalid snowflake
+	Snowflake(std::string const &str) :
+		m_Value(Parse(str.data(), str.size()))
+	{ }
+	Snowflake(const char *str) :
+		m_Value(str != nullptr ? Parse(str, std::strlen(str)) : 0)
+	{ }
+
+	uint64_t Value() const
+	{
+		return m_Value;
+	}
+	bool IsValid() const
+	{
+		return m_Value != 0;
+	}
+	std::string ToString() const
+	{
+		if (!IsValid())
+			return std::string();
+
+		fmt::format_int const str(m_Value);
+		return std::string(str.data(), str.size());
+	}
+
+	bool operator==(Snowflake const &rhs) const
+	{
+		return m_Value == rhs.m_Value;
+	}
+	bool operator!=(Snowflake const &rhs) const
+	{
+		return m_Value != rhs.m_Value;
+	}
+	bool operator<(Snowflake const &rhs) const
+	{
+		return m_Value < rhs.m_Value;
+	}
+
+private:
+	uint64_t m_Value = 0;
+
+	static uint64_t Parse(const char *str, size_t length)
+	{
+		if (length == 0 || length > 20)
+			return 0;
+
+		uint64_t value = 0;
+		for (size_t i = 0; i != length; ++i)
+		{
+			if (str[i] < '0' || str[i] > '9')
+				return 0;
+
+			uint64_t const digit = static_cast<uint64_t>(str[i] - '0');
+			if (value > (UINT64_MAX - digit) / 10)
+				return 0; // overflow
+			value = value * 10 + digit;
+		}
+		return value;
+	}
+};
+
+// snowflakes are strings in JSON, invalid ones are null
+inline void to_json(nlohmann::json &j, Snowflake const &sfid)
+{
+	if (sfid.IsValid())
+		j = sfid.ToString();
+	else
+		j = nullptr;
+}
+
+inline void from_json(nlohmann::json const &j, Snowflake &sfid)
+{
+	if (j.is_null())
+		sfid = Snowflake();
+	else if (j.is_number_unsigned())
+		sfid = Snowflake(j.get<uint64_t>());
+	else // throws a type_error if it's not a string either
+		sfid = Snowflake(j.get_ref<std::string const &>());
+}
+
+namespace fmt
+{
+	// accepts "{}" and "{:s}", the latter is still used by all the format
+	// strings written back when snowflakes were strings
+	template<>
+	struct formatter<Snowflake>
+	{
+		template<typename ParseContext>
+		auto parse(ParseContext &ctx) -> decltype(ctx.begin())
+		{
+			auto it = ctx.begin();
+			if (it != ctx.end() && *it == 's')
+				++it;
+			if (it != ctx.end() && *it != '}')
+				throw format_error("invalid format specifier for snowflake");
+			return it;
+		}
+
+		template<typename FormatContext>
+		auto format(Snowflake const &sfid, FormatContext &ctx) -> decltype(ctx.out())
+		{
+			if (!sfid.IsValid())
+				return ctx.out();
+
+			format_int const str(sfid.Value());
+			return std::copy(str.data(), str.data() + str.size(), ctx.out());
+		}
+	};
+}
+
+namespace std
+{
+	template<>
+	struct hash<Snowflake>
+	{
+		size_t operator()(Snowflake const &sfid) const noexcept
+		{
+			return hash<uint64_t>()(sfid.Value());
+		}
+	};
+}
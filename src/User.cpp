@@ -21,10 +21,15 @@ User::User(UserId_t pawn_id, json const &data) :
 
 void User::Update(json const &data, bool in_dispatch)
 {
+	std::string const old_name = UserManager::MakeUserName(m_Username, m_Discriminator);
+
 	_valid =
 		utils::TryGetJsonValue(data, m_Username, "username") &&
 		utils::TryGetJsonValue(data, m_Discriminator, "discriminator");
 
+	UserManager::Get()->UpdateUserName(m_PawnId,
+		old_name, UserManager::MakeUserName(m_Username, m_Discriminator));
+
 	if (!_valid)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
@@ -43,6 +48,32 @@ void User::Update(json const &data, bool in_dispatch)
 	}
 }
 
+void User::Update(gateway::User const &data, bool in_dispatch)
+{
+	_valid = !data.Username.empty() && !data.Discriminator.empty();
+	if (!_valid)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"can't update user: expected \"username\" and \"discriminator\" for user id \"{}\"",
+			data.Id);
+		return;
+	}
+
+	std::string const old_name = UserManager::MakeUserName(m_Username, m_Discriminator);
+	m_Username = data.Username;
+	m_Discriminator = data.Discriminator;
+	UserManager::Get()->UpdateUserName(m_PawnId,
+		old_name, UserManager::MakeUserName(m_Username, m_Discriminator));
+	m_IsBot = data.IsBot;
+	m_IsVerified = data.IsVerified;
+
+	if (in_dispatch)
+	{
+		pawn_cb::Error error;
+		pawn_cb::Callback::CallFirst(error, "DCC_OnUserUpdate", GetPawnId());
+	}
+}
+
 
 void UserManager::Initialize()
 {
@@ -56,7 +87,7 @@ void UserManager::Initialize()
 				"invalid JSON: expected \"user\" in \"{}\"", data.dump());
 			return;
 		}
-		AddUser(data["user"]); // that's our bot
+		m_BotUserId = AddUser(data["user"]); // that's our bot
 		m_Initialized++;
 	});
 
@@ -111,16 +142,17 @@ UserId_t UserManager::AddUser(json const &data)
 	if (user)
 		return user->GetPawnId();
 
-	UserId_t id = 1;
-	while (m_Users.find(id) != m_Users.end())
-		++id;
-
-	if (!m_Users.emplace(id, User_t(new User(id, data))).first->second)
+	UserId_t id = m_Users.Emplace([&](void *storage, UserId_t pawn_id)
+	{
+		return new (storage) User(pawn_id, data);
+	});
+	if (id == INVALID_USER_ID)
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR,
-			"can't create user: duplicate key '{}'", id);
+			"can't create user: out of user ids");
 		return INVALID_USER_ID;
 	}
+	m_UserIds.emplace(sfid, id);
 
 	Logger::Get()->Log(samplog_LogLevel::INFO, "successfully created user with id '{}'", id);
 	return id;
@@ -128,37 +160,26 @@ UserId_t UserManager::AddUser(json const &data)
 
 User_t const &UserManager::FindUser(UserId_t id)
 {
-	static User_t invalid_user;
-	auto it = m_Users.find(id);
-	if (it == m_Users.end())
-		return invalid_user;
-	return it->second;
+	return m_Users.Find(id);
 }
 
-User_t const &UserManager::FindUserByName(
-	std::string const &name, std::string const &discriminator)
+void UserManager::UpdateUserName(UserId_t id,
+	std::string const &old_name, std::string const &new_name)
 {
-	static User_t invalid_user;
-	for (auto const &u : m_Users)
-	{
-		User_t const &user = u.second;
-		if (user->GetUsername().compare(name) == 0
-			&& user->GetDiscriminator().compare(discriminator) == 0)
-		{
-			return user;
-		}
-	}
-	return invalid_user;
+	m_UserNames.Rename(old_name, new_name, id);
+}
+
+User_t const &UserManager::FindUserByName(std::string const &name,
+	std::string const &discriminator, bool case_sensitive)
+{
+	return FindUser(m_UserNames.Find(MakeUserName(name, discriminator), case_sensitive));
 }
 
 User_t const &UserManager::FindUserById(Snowflake_t const &sfid)
 {
 	static User_t invalid_user;
-	for (auto const &u : m_Users)
-	{
-		User_t const &user = u.second;
-		if (user->GetId().compare(sfid) == 0)
-			return user;
-	}
-	return invalid_user;
+	auto it = m_UserIds.find(sfid);
+	if (it == m_UserIds.end())
+		return invalid_user;
+	return FindUser(it->second);
 }
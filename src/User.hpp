@@ -2,9 +2,13 @@
 
 #include "Singleton.hpp"
 #include "types.hpp"
+#include "SlotMap.hpp"
+#include "NameIndex.hpp"
+#include "GatewayEvents.hpp"
 
 #include <string>
 #include <atomic>
+#include <unordered_map>
 
 #include <json.hpp>
 
@@ -69,6 +73,7 @@ public:
 	}
 
 	void Update(json const &data, bool in_dispatch = false);
+	void Update(gateway::User const &data, bool in_dispatch = false);
 };
 
 
@@ -83,7 +88,10 @@ private:
 	const unsigned int m_InitValue = 1;
 	std::atomic<unsigned int> m_Initialized{ 0 };
 
-	std::map<UserId_t, User_t> m_Users; //PAWN user-id to actual channel map
+	SlotMap<UserId_t, User> m_Users; //PAWN user-id to actual channel map
+	std::unordered_map<Snowflake_t, UserId_t> m_UserIds; //snowflake to PAWN user-id
+	NameIndex<UserId_t> m_UserNames; // by "username#discriminator"
+	UserId_t m_BotUserId = INVALID_USER_ID;
 
 
 public:
@@ -92,7 +100,21 @@ public:
 
 	UserId_t AddUser(json const &data);
 
+	inline UserId_t GetBotUserId() const
+	{
+		return m_BotUserId;
+	}
+
+	// keeps the name index in sync, called by the user itself
+	void UpdateUserName(UserId_t id,
+		std::string const &old_name, std::string const &new_name);
+	static std::string MakeUserName(std::string const &name, std::string const &discriminator)
+	{
+		return name + '#' + discriminator;
+	}
+
 	User_t const &FindUser(UserId_t id);
-	User_t const &FindUserByName(std::string const &name, std::string const &discriminator);
+	User_t const &FindUserByName(std::string const &name, std::string const &discriminator,
+		bool case_sensitive = true);
 	User_t const &FindUserById(Snowflake_t const &sfid);
 };
@@ -1,30 +1,248 @@
 #include "WebSocket.hpp"
 #include "Logger.hpp"
+#include "Intents.hpp"
+#include "SessionState.hpp"
 #include "sdk.hpp"
+#include "misc.hpp"
+#include "PawnDispatcher.hpp"
+#include "GatewayRecorder.hpp"
+#include "JsonWriter.hpp"
 
 #include <unordered_map>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <random>
 
 extern logprintf_t logprintf;
 
-WebSocket::WebSocket() :
-	_ioContext(),
-	_resolver(asio::make_strand(_ioContext)),
+const std::array<unsigned int, 12> WebSocket::LATENCY_BUCKETS{ {
+	25, 50, 75, 100, 150, 200, 300, 500, 750, 1000, 2000, 5000
+} };
+
+// Skips over one JSON value starting at 'pos' without building anything.
+// Returns false if the value is malformed or incomplete.
+bool SkipJsonValue(const char *str, size_t len, size_t &pos)
+{
+	int depth = 0;
+	do
+	{
+		if (pos >= len)
+			return false;
+
+		char const c = str[pos];
+		if (c == '"')
+		{
+			for (++pos; pos < len && str[pos] != '"'; ++pos)
+			{
+				if (str[pos] == '\\')
+					++pos;
+			}
+			if (pos >= len)
+				return false;
+			++pos;
+		}
+		else if (c == '{' || c == '[')
+		{
+			++depth;
+			++pos;
+		}
+		else if (c == '}' || c == ']')
+		{
+			if (depth == 0)
+				return false;
+			--depth;
+			++pos;
+		}
+		else if (depth == 0)
+		{
+			// number, boolean or null
+			while (pos < len && str[pos] != ',' && str[pos] != '}'
+				&& str[pos] != ']' && !isspace(static_cast<unsigned char>(str[pos])))
+			{
+				++pos;
+			}
+		}
+		else
+		{
+			++pos;
+		}
+	} while (depth > 0);
+
+	return true;
+}
+
+void SkipJsonWhitespace(const char *str, size_t len, size_t &pos)
+{
+	while (pos < len && isspace(static_cast<unsigned char>(str[pos])))
+		++pos;
+}
+
+// Calls 'func(key, key_length, value_pos, value_end)' for every member of the
+// JSON object starting at 'pos', until it returns false. Keys are expected
+// to contain no escapes. Returns false if the object is malformed.
+template<typename F>
+bool ForEachJsonMember(const char *str, size_t len, size_t pos, F &&func)
+{
+	SkipJsonWhitespace(str, len, pos);
+	if (pos >= len || str[pos] != '{')
+		return false;
+	++pos;
+
+	while (true)
+	{
+		SkipJsonWhitespace(str, len, pos);
+		if (pos >= len)
+			return false;
+		if (str[pos] == '}')
+			return true;
+		if (str[pos] == ',')
+		{
+			++pos;
+			continue;
+		}
+		if (str[pos] != '"')
+			return false;
+
+		const char *key_end = static_cast<const char *>(
+			memchr(str + pos + 1, '"', len - pos - 1));
+		if (key_end == nullptr)
+			return false;
+		size_t const key_pos = pos + 1,
+			key_len = (key_end - str) - key_pos;
+
+		pos = key_pos + key_len + 1;
+		SkipJsonWhitespace(str, len, pos);
+		if (pos >= len || str[pos] != ':')
+			return false;
+		++pos;
+		SkipJsonWhitespace(str, len, pos);
+
+		size_t const value_pos = pos;
+		if (!SkipJsonValue(str, len, pos))
+			return false;
+
+		if (!func(str + key_pos, key_len, value_pos, pos))
+			return true;
+	}
+}
+
+bool ScanPayloadHeader(const char *payload, size_t len, WebSocket::PayloadHeader &dest)
+{
+	bool has_opcode = false,
+		has_event = false,
+		valid_opcode = true;
+	bool const valid_payload = ForEachJsonMember(payload, len, 0,
+		[&](const char *key, size_t key_len, size_t value_pos, size_t value_end)
+	{
+		if (key_len == 2 && key[0] == 'o' && key[1] == 'p')
+		{
+			has_opcode = ConvertStrToData(
+				std::string(payload + value_pos, value_end - value_pos), dest.Opcode);
+			valid_opcode = has_opcode;
+		}
+		else if (key_len == 1 && key[0] == 't')
+		{
+			has_event = true;
+			if (payload[value_pos] == '"')
+			{
+				dest.EventName = payload + value_pos + 1;
+				dest.EventNameLength = value_end - value_pos - 2;
+			}
+		}
+		else if (key_len == 1 && key[0] == 's')
+		{
+			if (payload[value_pos] != 'n') // null
+			{
+				dest.HasSequence = ConvertStrToData(
+					std::string(payload + value_pos, value_end - value_pos), dest.Sequence);
+			}
+		}
+		return valid_opcode && !(has_opcode && has_event && dest.HasSequence);
+	});
+
+	return valid_payload && valid_opcode && has_opcode;
+}
+
+// reads the session fields of a READY payload without parsing the rest of it
+void ScanReadySession(const char *payload, size_t len,
+	std::string &session_id, std::string &resume_url)
+{
+	auto const key_equals = [](const char *key, size_t key_len, const char *name)
+	{
+		return key_len == strlen(name) && memcmp(key, name, key_len) == 0;
+	};
+
+	ForEachJsonMember(payload, len, 0,
+		[&](const char *key, size_t key_len, size_t value_pos, size_t)
+	{
+		if (!key_equals(key, key_len, "d"))
+			return true;
+
+		ForEachJsonMember(payload, len, value_pos,
+			[&](const char *key, size_t key_len, size_t value_pos, size_t value_end)
+		{
+			std::string *dest = nullptr;
+			if (key_equals(key, key_len, "session_id"))
+				dest = &session_id;
+			else if (key_equals(key, key_len, "resume_gateway_url"))
+				dest = &resume_url;
+
+			// neither field contains escapes
+			if (dest != nullptr && payload[value_pos] == '"')
+				dest->assign(payload + value_pos + 1, value_end - value_pos - 2);
+			return session_id.empty() || resume_url.empty();
+		});
+		return false;
+	});
+}
+
+beast::flat_buffer MakeFrameBuffer(std::string const &data)
+{
+	beast::flat_buffer buffer;
+	buffer.commit(asio::buffer_copy(buffer.prepare(data.size()), asio::buffer(data)));
+	return buffer;
+}
+
+WebSocket::WebSocket(asio::io_context &io_context) :
+	_strand(asio::make_strand(io_context)),
+	_resolver(_strand),
 	_sslContext(asio::ssl::context::tlsv12_client),
-	_reconnectTimer(_ioContext),
-	m_HeartbeatTimer(_ioContext),
+	_reconnectTimer(_strand),
+	_readPauseTimer(_strand),
+	m_HeartbeatTimer(_strand),
 	m_HeartbeatInterval()
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::WebSocket");
+
+	_buffer.reserve(READ_BUFFER_CAPACITY);
 }
 
 WebSocket::~WebSocket()
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::~WebSocket");
 
-	Disconnect();
+	Stop();
+	StopDecoding(false);
+}
 
-	if (_netThread)
-		_netThread->join();
+void WebSocket::Stop()
+{
+	if (_replaying)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_replayMutex);
+			_stopReplay = true;
+		}
+		_replayCondition.notify_all();
+		_replayThread->join();
+		_replaying = false;
+	}
+	else if (_running)
+	{
+		Shutdown(false);
+		_running = false;
+	}
 }
 
 void WebSocket::Initialize(std::string token, std::string gateway_url, int intents)
@@ -34,11 +252,185 @@ void WebSocket::Initialize(std::string token, std::string gateway_url, int inten
 	_gatewayUrl = gateway_url;
 	_apiToken = token;
 	_intents = intents;
-	Connect();
+	Run();
+}
+
+void WebSocket::Resume(std::string token, int intents, SessionState &&state)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Resume");
+
+	_gatewayUrl = state.ResumeGatewayUrl;
+	_resumeGatewayUrl = state.ResumeGatewayUrl;
+	_apiToken = token;
+	_intents = intents;
+	m_SessionId = state.SessionId;
+	_sequenceNumber = state.Sequence;
+	_reconnect = true;
+
+	// rebuild the cache from the snapshot before any resumed event arrives
+	_decodeQueue.push_back({ Event::READY,
+		MakeFrameBuffer(json{ { "d", std::move(state.Ready) } }.dump()) });
+	for (auto &g : state.Guilds)
+	{
+		_decodeQueue.push_back({ Event::GUILD_CREATE,
+			MakeFrameBuffer(json{ { "d", std::move(g) } }.dump()) });
+	}
+
+	Run();
+}
+
+bool WebSocket::Suspend(SessionState &dest)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Suspend");
+
+	// a replayed session can't be resumed
+	if (!_running || _replaying)
+		return false;
+
+	Shutdown(true);
+	_running = false;
+
+	// every event that was read has to end up in the cache
+	StopDecoding(true);
+
+	// the session is owned by the strand, wait until it is done with it
+	std::promise<void> synced;
+	asio::post(_strand, [&synced]()
+	{
+		synced.set_value();
+	});
+	synced.get_future().wait();
+
+	if (m_SessionId.empty() || _resumeGatewayUrl.empty())
+		return false;
+
+	dest.TokenHash = SessionState::GetTokenHash(_apiToken);
+	dest.Intents = _intents;
+	dest.SessionId = m_SessionId;
+	dest.Sequence = _sequenceNumber;
+	dest.ResumeGatewayUrl = _resumeGatewayUrl;
+	return true;
+}
+
+void WebSocket::Replay(std::string const &file, double speed)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Replay");
+
+	_replaying = true;
+
+	_decodeThread = std::make_unique<std::thread>([this]()
+	{
+		ProcessDecodeQueue();
+	});
 
-	_netThread = std::make_unique<std::thread>([this]()
+	_replayThread = std::make_unique<std::thread>([this, file, speed]()
 	{
-		_ioContext.run();
+		ReplayFrames(file, speed);
+	});
+}
+
+void WebSocket::ReplayFrames(std::string const &file, double speed)
+{
+	std::ifstream stream(file, std::ios::binary | std::ios::ate);
+	std::streamoff const file_size = stream ? static_cast<std::streamoff>(stream.tellg()) : 0;
+	stream.seekg(0);
+	if (!stream || !GatewayRecorder::ReadHeader(stream))
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"can't replay gateway traffic: '{}' is not a gateway record file", file);
+		return;
+	}
+
+	Logger::Get()->Log(samplog_LogLevel::INFO, "replaying gateway traffic from '{}'", file);
+
+	// long gaps, e.g. between two recorded sessions, are shortened
+	uint64_t const MAX_GAP_US = 5000000;
+
+	auto const start_time = std::chrono::steady_clock::now();
+	unsigned int event_count = 0;
+	uint64_t last_timestamp = 0;
+	GatewayRecorder::FrameHeader frame;
+	while (!_stopReplay && GatewayRecorder::ReadFrameHeader(stream, frame))
+	{
+		// a truncated or corrupt file must not make us allocate arbitrary amounts
+		std::streamoff const offset = stream.tellg();
+		if (frame.Length > GatewayRecorder::MAX_FRAME_LENGTH
+			|| offset < 0 || frame.Length > file_size - offset)
+		{
+			Logger::Get()->Log(samplog_LogLevel::ERROR,
+				"can't replay gateway traffic: invalid frame of {:d} bytes at offset {:d} in '{}'",
+				frame.Length, static_cast<long long>(offset), file);
+			break;
+		}
+
+		beast::flat_buffer payload = AcquireReadBuffer();
+		auto const payload_data = payload.prepare(frame.Length);
+		if (!stream.read(static_cast<char *>(payload_data.data()), frame.Length))
+		{
+			RecycleReadBuffer(std::move(payload));
+			break;
+		}
+		payload.commit(frame.Length);
+
+		if (speed > 0.0 && last_timestamp != 0 && frame.Timestamp > last_timestamp)
+		{
+			auto const gap = std::min(frame.Timestamp - last_timestamp, MAX_GAP_US);
+			std::unique_lock<std::mutex> lock(_replayMutex);
+			_replayCondition.wait_for(lock,
+				std::chrono::microseconds(static_cast<uint64_t>(gap / speed)),
+				[this]() { return _stopReplay.load(); });
+		}
+		last_timestamp = frame.Timestamp;
+
+		// same backpressure as reading from the gateway, and don't
+		// read the whole file ahead of the decode thread
+		while (!_stopReplay)
+		{
+			bool decode_queue_full;
+			{
+				std::lock_guard<std::mutex> lock(_decodeQueueMutex);
+				decode_queue_full = _decodeQueue.size() >= READ_BUFFER_POOL_SIZE;
+			}
+			if (!decode_queue_full && !PawnDispatcher::Get()->IsSaturated())
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// only dispatch events are replayed, the rest is connection handling
+		PayloadHeader header;
+		Event event;
+		if (frame.Opcode != 0
+			|| !ScanPayloadHeader(static_cast<const char *>(payload.data().data()),
+				payload.size(), header)
+			|| !GetDispatchEvent(header, event))
+		{
+			RecycleReadBuffer(std::move(payload));
+			continue;
+		}
+
+		QueueEvent(event, std::move(payload));
+		++event_count;
+	}
+
+	Logger::Get()->Log(samplog_LogLevel::INFO,
+		"gateway replay finished: {:d} events in {:d} ms", event_count,
+		std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start_time).count());
+}
+
+void WebSocket::Run()
+{
+	_running = true;
+
+	_decodeThread = std::make_unique<std::thread>([this]()
+	{
+		ProcessDecodeQueue();
+	});
+
+	asio::post(_strand, [this]()
+	{
+		Connect();
 	});
 }
 
@@ -46,8 +438,12 @@ void WebSocket::Connect()
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Connect");
 
+	// sessions have to be resumed on the gateway they were created on
+	_host = (_reconnect && !_resumeGatewayUrl.empty())
+		? _resumeGatewayUrl : _gatewayUrl;
+
 	_resolver.async_resolve(
-		_gatewayUrl,
+		_host,
 		"443",
 		beast::bind_front_handler(
 			&WebSocket::OnResolve,
@@ -63,13 +459,12 @@ void WebSocket::OnResolve(beast::error_code ec,
 	{
 		Logger::Get()->Log(samplog_LogLevel::ERROR, 
 			"Can't resolve Discord gateway URL '{}': {} ({})",
-			_gatewayUrl, ec.message(), ec.value());
+			_host, ec.message(), ec.value());
 		Disconnect(true);
 		return;
 	}
 
-	_websocket.reset(
-		new WebSocketStream_t(asio::make_strand(_ioContext), _sslContext));
+	_websocket.reset(new WebSocketStream_t(_strand, _sslContext));
 
 	beast::get_lowest_layer(*_websocket).expires_after(
 		std::chrono::seconds(30));
@@ -134,7 +529,7 @@ void WebSocket::OnSslHandshake(beast::error_code ec)
 	}));
 
 	_websocket->async_handshake(
-		_gatewayUrl + ":443", 
+		_host + ":443",
 		"/?encoding=json&v=10",
 		beast::bind_front_handler(
 			&WebSocket::OnHandshake,
@@ -164,7 +559,7 @@ void WebSocket::OnHandshake(beast::error_code ec)
 		Identify();
 }
 
-void WebSocket::Disconnect(bool reconnect /*= false*/)
+void WebSocket::Disconnect(bool reconnect /*= false*/, bool resumable /*= false*/)
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Disconnect");
 
@@ -172,14 +567,55 @@ void WebSocket::Disconnect(bool reconnect /*= false*/)
 
 	if (_websocket)
 	{
+		// Discord invalidates the session when closing normally
 		_websocket->async_close(
-			beast::websocket::close_code::normal,
+			(reconnect || resumable)
+				? beast::websocket::close_code::service_restart
+				: beast::websocket::close_code::normal,
 			beast::bind_front_handler(
 				&WebSocket::OnClose,
 				this));
 	}
 }
 
+void WebSocket::Shutdown(bool resumable)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Shutdown");
+
+	auto closed = std::make_shared<std::promise<void>>();
+	auto closed_future = closed->get_future();
+	asio::post(_strand, [this, resumable, closed]()
+	{
+		_reconnectTimer.cancel();
+		if (!_websocket)
+		{
+			closed->set_value();
+			return;
+		}
+
+		_shutdownPromise = closed;
+		_shutdownClosed = false;
+		Disconnect(false, resumable);
+	});
+
+	if (closed_future.wait_for(std::chrono::seconds(10)) == std::future_status::timeout)
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"timeout while closing websocket gateway connection");
+	}
+}
+
+void WebSocket::FinishShutdown()
+{
+	// the pending read completes after the connection is closed
+	if (!_shutdownPromise || !_shutdownClosed || _readPending)
+		return;
+
+	_websocket.reset();
+	_shutdownPromise->set_value();
+	_shutdownPromise.reset();
+}
+
 void WebSocket::OnClose(beast::error_code ec)
 {
 	boost::ignore_unused(ec);
@@ -187,6 +623,16 @@ void WebSocket::OnClose(beast::error_code ec)
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::OnClose");
 
 	m_HeartbeatTimer.cancel();
+	_readPauseTimer.cancel();
+	_readPaused = false;
+	_writeQueue.clear();
+
+	if (_shutdownPromise)
+	{
+		_shutdownClosed = true;
+		FinishShutdown();
+		return;
+	}
 
 	if (_reconnect)
 	{
@@ -236,6 +682,32 @@ void WebSocket::Read()
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Read");
 
+	// stop pulling events from the gateway while the server doesn't keep up
+	// with them; if this takes too long the connection gets resumed later on
+	if (PawnDispatcher::Get()->IsSaturated())
+	{
+		if (!_readPaused)
+		{
+			Logger::Get()->Log(samplog_LogLevel::WARNING,
+				"pausing websocket gateway reads until the Pawn dispatch queue drains");
+			_readPaused = true;
+		}
+
+		_readPauseTimer.expires_from_now(std::chrono::milliseconds(50));
+		_readPauseTimer.async_wait(
+			beast::bind_front_handler(
+				&WebSocket::OnReadPause,
+				this));
+		return;
+	}
+
+	if (_readPaused)
+	{
+		Logger::Get()->Log(samplog_LogLevel::INFO, "resuming websocket gateway reads");
+		_readPaused = false;
+	}
+
+	_readPending = true;
 	_websocket->async_read(
 		_buffer,
 		beast::bind_front_handler(
@@ -243,6 +715,15 @@ void WebSocket::Read()
 			this));
 }
 
+void WebSocket::OnReadPause(beast::error_code ec)
+{
+	// timer gets cancelled when the connection is closed
+	if (ec || !_websocket)
+		return;
+
+	Read();
+}
+
 void WebSocket::OnRead(beast::error_code ec,
 	std::size_t bytes_transferred)
 {
@@ -250,8 +731,16 @@ void WebSocket::OnRead(beast::error_code ec,
 		"WebSocket::OnRead({:d})",
 		bytes_transferred);
 
+	_readPending = false;
+
 	if (ec)
 	{
+		if (_shutdownPromise)
+		{
+			FinishShutdown();
+			return;
+		}
+
 		bool reconnect = false;
 		switch (ec.value())
 		{
@@ -292,109 +781,75 @@ void WebSocket::OnRead(beast::error_code ec,
 		return;
 	}
 
-	json result = json::parse(
-		beast::buffers_to_string(_buffer.data()));
-	_buffer.clear();
-
-	int payload_opcode = result["op"].get<int>();
-	switch (payload_opcode)
-	{
-	case 0:
-	{
-		_sequenceNumber = result["s"];
-
-#define __WS_EVENT_MAP_PAIR(event) { #event, Event::event }
-		static const std::unordered_map<std::string, Event> events_map{
-			__WS_EVENT_MAP_PAIR(READY),
-			__WS_EVENT_MAP_PAIR(RESUMED),
-			__WS_EVENT_MAP_PAIR(GUILD_CREATE),
-			__WS_EVENT_MAP_PAIR(GUILD_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_DELETE),
-			__WS_EVENT_MAP_PAIR(GUILD_ROLE_CREATE),
-			__WS_EVENT_MAP_PAIR(GUILD_ROLE_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_ROLE_DELETE),
-			__WS_EVENT_MAP_PAIR(CHANNEL_CREATE),
-			__WS_EVENT_MAP_PAIR(CHANNEL_UPDATE),
-			__WS_EVENT_MAP_PAIR(CHANNEL_DELETE),
-			__WS_EVENT_MAP_PAIR(CHANNEL_PINS_UPDATE),
-			__WS_EVENT_MAP_PAIR(THREAD_CREATE),
-			__WS_EVENT_MAP_PAIR(THREAD_UPDATE),
-			__WS_EVENT_MAP_PAIR(THREAD_DELETE),
-			__WS_EVENT_MAP_PAIR(THREAD_LIST_SYNC),
-			__WS_EVENT_MAP_PAIR(THREAD_MEMBER_UPDATE),
-			__WS_EVENT_MAP_PAIR(THREAD_MEMBERS_UPDATE),
-			__WS_EVENT_MAP_PAIR(STAGE_INSTANCE_CREATE),
-			__WS_EVENT_MAP_PAIR(STAGE_INSTANCE_UPDATE),
-			__WS_EVENT_MAP_PAIR(STAGE_INSTANCE_DELETE),
-			__WS_EVENT_MAP_PAIR(GUILD_MEMBER_ADD),
-			__WS_EVENT_MAP_PAIR(GUILD_MEMBER_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_MEMBER_REMOVE),
-			__WS_EVENT_MAP_PAIR(THREAD_MEMBERS_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_AUDIT_LOG_ENTRY_CREATE),
-			__WS_EVENT_MAP_PAIR(GUILD_BAN_ADD),
-			__WS_EVENT_MAP_PAIR(GUILD_BAN_REMOVE),
-			__WS_EVENT_MAP_PAIR(GUILD_EMOJIS_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_STICKERS_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_INTEGRATIONS_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_MEMBERS_CHUNK),
-			__WS_EVENT_MAP_PAIR(INTEGRATION_CREATE),
-			__WS_EVENT_MAP_PAIR(INTEGRATION_UPDATE),
-			__WS_EVENT_MAP_PAIR(INTEGRATION_DELETE),
-			__WS_EVENT_MAP_PAIR(WEBHOOKS_UPDATE),
-			__WS_EVENT_MAP_PAIR(INVITE_CREATE),
-			__WS_EVENT_MAP_PAIR(INVITE_DELETE),
-			__WS_EVENT_MAP_PAIR(VOICE_STATE_UPDATE),
-			__WS_EVENT_MAP_PAIR(PRESENCE_UPDATE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_CREATE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_UPDATE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_DELETE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_DELETE_BULK),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_ADD),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_REMOVE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_REMOVE_ALL),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_REMOVE_EMOJI),
-			__WS_EVENT_MAP_PAIR(TYPING_START),
-			__WS_EVENT_MAP_PAIR(MESSAGE_CREATE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_UPDATE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_DELETE),
-			__WS_EVENT_MAP_PAIR(CHANNEL_PINS_UPDATE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_ADD),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_REMOVE),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_REMOVE_ALL),
-			__WS_EVENT_MAP_PAIR(MESSAGE_REACTION_REMOVE_EMOJI),
-			__WS_EVENT_MAP_PAIR(TYPING_START),
-			//__WS_EVENT_MAP_PAIR(MESSAGE_CONTENT),
-			__WS_EVENT_MAP_PAIR(GUILD_SCHEDULED_EVENT_CREATE),
-			__WS_EVENT_MAP_PAIR(GUILD_SCHEDULED_EVENT_UPDATE),
-			__WS_EVENT_MAP_PAIR(GUILD_SCHEDULED_EVENT_DELETE),
-			__WS_EVENT_MAP_PAIR(GUILD_SCHEDULED_EVENT_USER_ADD),
-			__WS_EVENT_MAP_PAIR(GUILD_SCHEDULED_EVENT_USER_REMOVE),
-			__WS_EVENT_MAP_PAIR(AUTO_MODERATION_RULE_CREATE),
-			__WS_EVENT_MAP_PAIR(AUTO_MODERATION_RULE_UPDATE),
-			__WS_EVENT_MAP_PAIR(AUTO_MODERATION_RULE_DELETE),
-			__WS_EVENT_MAP_PAIR(AUTO_MODERATION_ACTION_EXECUTION),
-			__WS_EVENT_MAP_PAIR(INTERACTION_CREATE),
-		};
-
-		auto it = events_map.find(result["t"].get<std::string>());
-		if (it != events_map.end())
-		{
-			json &data = result["d"];
-			Event event = it->second;
+	// the frame is scanned and parsed straight from the read buffer
+	auto const frame = _buffer.data();
+	const char *payload = static_cast<const char *>(frame.data());
+	size_t const payload_size = frame.size();
+
+	// only look at the envelope first, the "d" field is skipped over
+	PayloadHeader header;
+	bool const valid_payload = ScanPayloadHeader(payload, payload_size, header);
+	GatewayRecorder::Get()->Record(header.Opcode, payload, payload_size);
+	if (!valid_payload)
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"Received malformed gateway payload ({:d} bytes)", payload_size);
+		ResetReadBuffer(_buffer);
+		Read();
+		return;
+	}
 
-			if (event == Event::READY)
-				m_SessionId = data["session_id"].get<std::string>();
+	if (header.Opcode == 0)
+	{
+		if (header.HasSequence)
+			_sequenceNumber = header.Sequence;
 
-			auto event_range = m_EventMap.equal_range(event);
-			for (auto ev_it = event_range.first; ev_it != event_range.second; ++ev_it)
-				ev_it->second(data);
+		Event event;
+		if (!GetDispatchEvent(header, event))
+		{
+			ResetReadBuffer(_buffer);
+			Read();
+			return;
 		}
-		else
+
+		// the session has to be known right away, a reconnect that is
+		// handled before the decode thread gets to READY has to resume it
+		if (event == Event::READY)
 		{
-			Logger::Get()->Log(samplog_LogLevel::WARNING, "Unknown gateway event '{}'", result["t"].get<std::string>());
-			Logger::Get()->Log(samplog_LogLevel::DEBUG, "UGE res: {}", result.dump(4));
+			std::string session_id, resume_url;
+			ScanReadySession(payload, payload_size, session_id, resume_url);
+
+			// get rid of protocol
+			size_t protocol_pos = resume_url.find("wss://");
+			if (protocol_pos != std::string::npos)
+				resume_url.erase(protocol_pos, 6); // 6 = length of "wss://"
+
+			m_SessionId = session_id;
+			_resumeGatewayUrl = resume_url;
 		}
-	} break;
+
+		// parsing and running the handlers happens on the decode thread,
+		// so that big payloads don't delay reading and heartbeating
+		// the read buffer itself is handed over, we continue with a recycled one
+		QueueEvent(event, std::move(_buffer));
+		_buffer = AcquireReadBuffer();
+
+		Read();
+		return;
+	}
+
+	json result = json::parse(payload, payload + payload_size, nullptr, false);
+	ResetReadBuffer(_buffer);
+	if (result.is_discarded())
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"Can't parse gateway payload with opcode '{}'", header.Opcode);
+		Read();
+		return;
+	}
+
+	switch (header.Opcode)
+	{
 	case 7: // reconnect
 		Logger::Get()->Log(samplog_LogLevel::INFO,
 			"websocket gateway requested reconnect; attempting reconnect...");
@@ -403,29 +858,208 @@ void WebSocket::OnRead(beast::error_code ec,
 	case 9: // invalid session
 		Identify();
 		break;
+	case 1: // heartbeat request
+		SendHeartbeat();
+		break;
 	case 10: // hello
+	{
 		// at this point we're connected to the gateway, but not authenticated
 		// start heartbeat
 		m_HeartbeatInterval = std::chrono::milliseconds(result["d"]["heartbeat_interval"]);
-		DoHeartbeat({});
-		break;
+		_heartbeatAcked = true;
+
+		// the first heartbeat is sent after interval * jitter (0..1), as
+		// requested by Discord to spread out reconnecting clients
+		static std::mt19937 random_engine{ std::random_device{}() };
+		std::uniform_real_distribution<double> jitter(0.0, 1.0);
+		m_HeartbeatTimer.expires_from_now(
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				m_HeartbeatInterval * jitter(random_engine)));
+		m_HeartbeatTimer.async_wait(
+			beast::bind_front_handler(
+				&WebSocket::DoHeartbeat,
+				this));
+	} break;
 	case 11: // heartbeat ACK
 		Logger::Get()->Log(samplog_LogLevel::DEBUG, "heartbeat ACK");
+		if (!_heartbeatAcked)
+		{
+			_heartbeatAcked = true;
+			RecordLatency(std::chrono::steady_clock::now() - _heartbeatSendTime);
+		}
 		break;
 	default:
-		Logger::Get()->Log(samplog_LogLevel::WARNING, "Unhandled payload opcode '{}'", payload_opcode);
+		Logger::Get()->Log(samplog_LogLevel::WARNING, "Unhandled payload opcode '{}'", header.Opcode);
 		Logger::Get()->Log(samplog_LogLevel::DEBUG, "UPO res: {}", result.dump(4));
 	}
 
 	Read();
 }
 
-void WebSocket::Write(std::string const &data)
+bool WebSocket::GetDispatchEvent(PayloadHeader const &header, Event &dest) const
+{
+	if (!ParseEventName(header.EventName, header.EventNameLength, dest))
+	{
+		Logger::Get()->Log(samplog_LogLevel::WARNING, "Unknown gateway event '{}'",
+			std::string(header.EventName, header.EventNameLength));
+		return false;
+	}
+
+	// READY always has to be decoded for the session id
+	return dest == Event::READY
+		|| !m_EventHandlers[static_cast<size_t>(dest)].empty()
+		|| !m_RawEventHandlers[static_cast<size_t>(dest)].empty();
+}
+
+void WebSocket::QueueEvent(Event event, beast::flat_buffer &&payload)
+{
+	{
+		std::lock_guard<std::mutex> lock(_decodeQueueMutex);
+		_decodeQueue.push_back({ event, std::move(payload) });
+	}
+	_decodeQueueCondition.notify_one();
+}
+
+beast::flat_buffer WebSocket::AcquireReadBuffer()
+{
+	std::lock_guard<std::mutex> lock(_decodeQueueMutex);
+	if (_bufferPool.empty())
+	{
+		beast::flat_buffer buffer;
+		buffer.reserve(READ_BUFFER_CAPACITY);
+		return buffer;
+	}
+
+	beast::flat_buffer buffer = std::move(_bufferPool.back());
+	_bufferPool.pop_back();
+	return buffer;
+}
+
+void WebSocket::ProcessDecodeQueue()
+{
+	while (true)
+	{
+		DecodeQueueEntry entry;
+		{
+			std::unique_lock<std::mutex> lock(_decodeQueueMutex);
+			_decodeQueueCondition.wait(lock, [this]()
+			{
+				return _stopDecoding || !_decodeQueue.empty();
+			});
+
+			if (_stopDecoding && (!_drainDecodeQueue || _decodeQueue.empty()))
+				return;
+
+			entry = std::move(_decodeQueue.front());
+			_decodeQueue.pop_front();
+		}
+
+		DecodeEvent(entry.event, entry.payload);
+		RecycleReadBuffer(std::move(entry.payload));
+	}
+}
+
+void WebSocket::ResetReadBuffer(beast::flat_buffer &buffer)
+{
+	buffer.consume(buffer.size());
+
+	// don't keep the memory of an unusually big frame (e.g. GUILD_CREATE) around
+	if (buffer.capacity() > READ_BUFFER_SHRINK_THRESHOLD)
+	{
+		buffer.shrink_to_fit();
+		buffer.reserve(READ_BUFFER_CAPACITY);
+	}
+}
+
+void WebSocket::RecycleReadBuffer(beast::flat_buffer &&buffer)
+{
+	ResetReadBuffer(buffer);
+
+	std::lock_guard<std::mutex> lock(_decodeQueueMutex);
+	if (_bufferPool.size() < READ_BUFFER_POOL_SIZE)
+		_bufferPool.push_back(std::move(buffer));
+}
+
+void WebSocket::StopDecoding(bool drain)
+{
+	{
+		std::lock_guard<std::mutex> lock(_decodeQueueMutex);
+		_stopDecoding = true;
+		_drainDecodeQueue = drain;
+	}
+	_decodeQueueCondition.notify_one();
+
+	if (_decodeThread)
+	{
+		_decodeThread->join();
+		_decodeThread.reset();
+	}
+}
+
+void WebSocket::DecodeEvent(Event event, beast::flat_buffer const &payload)
+{
+	const char *data_begin = static_cast<const char *>(payload.data().data());
+	for (auto &handler : m_RawEventHandlers[static_cast<size_t>(event)])
+		handler(data_begin, payload.size());
+
+	if (m_EventHandlers[static_cast<size_t>(event)].empty())
+		return;
+
+	json result = json::parse(data_begin, data_begin + payload.size(), nullptr, false);
+	if (result.is_discarded())
+	{
+		Logger::Get()->Log(samplog_LogLevel::ERROR,
+			"Can't parse payload of gateway event '{}'", static_cast<int>(event));
+		return;
+	}
+
+	json &data = result["d"];
+
+	// only the last handler gets the original, so the payload is never
+	// copied for the usual single handler
+	auto &handlers = m_EventHandlers[static_cast<size_t>(event)];
+	for (size_t i = 0; i != handlers.size(); ++i)
+	{
+		if (i + 1 == handlers.size())
+			handlers[i](std::move(data));
+		else
+			handlers[i](json(data));
+	}
+}
+
+std::string WebSocket::AcquireWriteBuffer()
+{
+	std::lock_guard<std::mutex> lock(_writeBufferPoolMutex);
+	if (_writeBufferPool.empty())
+		return std::string();
+
+	std::string buffer = std::move(_writeBufferPool.back());
+	_writeBufferPool.pop_back();
+	return buffer;
+}
+
+void WebSocket::Write(std::string data)
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::Write");
 
+	// can be called from any thread, the websocket stream is only ever
+	// accessed from the strand
+	asio::post(_strand, [this, data = std::move(data)]() mutable
+	{
+		if (!_websocket)
+			return;
+
+		_writeQueue.push_back(std::move(data));
+		// only one write may be in flight at a time
+		if (_writeQueue.size() == 1)
+			DoWrite();
+	});
+}
+
+void WebSocket::DoWrite()
+{
 	_websocket->async_write(
-		asio::buffer(data),
+		asio::buffer(_writeQueue.front()),
 		beast::bind_front_handler(
 			&WebSocket::OnWrite,
 			this));
@@ -445,7 +1079,18 @@ void WebSocket::OnWrite(beast::error_code ec,
 			ec.message(), ec.value());
 
 		// we don't handle reconnects here, as the read handler already does this
+		_writeQueue.clear();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_writeBufferPoolMutex);
+		if (_writeBufferPool.size() < WRITE_BUFFER_POOL_SIZE)
+			_writeBufferPool.push_back(std::move(_writeQueue.front()));
 	}
+	_writeQueue.pop_front();
+	if (!_writeQueue.empty())
+		DoWrite();
 }
 
 void WebSocket::Identify()
@@ -459,81 +1104,362 @@ void WebSocket::Identify()
 		"Linux";
 #endif
 
-	json identify_payload = {
-		{ "op", 2 },
-		{ "d",{
-			{ "token", _apiToken },
-			{ "compress", false },
-			{ "intents", _intents },
-			{ "large_threshold", LARGE_THRESHOLD_NUMBER },
-			{ "properties",{
-				{ "$os", os_name },
-				{ "$browser", BOOST_BEAST_VERSION_STRING },
-				{ "$device", "SA-MP/open.mp DCC plugin" },
-				{ "$referrer", "" },
-				{ "$referring_domain", "" }
-			} }
-		} }
-	};
-
-	Write(identify_payload.dump());
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter(payload)
+		.BeginObject()
+		.Int("op", 2)
+		.BeginObject("d")
+			.String("token", _apiToken)
+			.Bool("compress", false)
+			.Int("intents", _intents)
+			.Int("large_threshold", LARGE_THRESHOLD_NUMBER)
+			.BeginObject("properties")
+				.String("$os", os_name)
+				.String("$browser", BOOST_BEAST_VERSION_STRING)
+				.String("$device", "SA-MP/open.mp DCC plugin")
+				.String("$referrer", "")
+				.String("$referring_domain", "")
+			.EndObject()
+		.EndObject()
+		.EndObject();
+
+	Write(std::move(payload));
 }
 
 void WebSocket::SendResumePayload()
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::SendResumePayload");
 
-	json resume_payload = {
-		{ "op", 6 },
-		{ "d",{
-			{ "token", _apiToken },
-			{ "session_id", m_SessionId },
-			{ "seq", _sequenceNumber }
-		} }
-	};
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter(payload)
+		.BeginObject()
+		.Int("op", 6)
+		.BeginObject("d")
+			.String("token", _apiToken)
+			.String("session_id", m_SessionId)
+			.Int("seq", _sequenceNumber)
+		.EndObject()
+		.EndObject();
+
+	Write(std::move(payload));
+}
+
+bool WebSocket::ParseEventName(const char *name, size_t length, Event &dest)
+{
+#define __WS_EVENT_NAME_CASE(event) \
+	if (memcmp(name, #event, length) == 0) \
+	{ \
+		dest = Event::event; \
+		return true; \
+	}
+
+	// the length alone narrows it down to a handful of candidates
+	switch (length)
+	{
+	case 5:
+		__WS_EVENT_NAME_CASE(READY)
+		break;
+	case 7:
+		__WS_EVENT_NAME_CASE(RESUMED)
+		break;
+	case 11:
+		__WS_EVENT_NAME_CASE(USER_UPDATE)
+		break;
+	case 12:
+		__WS_EVENT_NAME_CASE(GUILD_CREATE)
+		__WS_EVENT_NAME_CASE(GUILD_DELETE)
+		__WS_EVENT_NAME_CASE(GUILD_UPDATE)
+		__WS_EVENT_NAME_CASE(TYPING_START)
+		break;
+	case 13:
+		__WS_EVENT_NAME_CASE(GUILD_BAN_ADD)
+		__WS_EVENT_NAME_CASE(INVITE_CREATE)
+		__WS_EVENT_NAME_CASE(INVITE_DELETE)
+		__WS_EVENT_NAME_CASE(THREAD_CREATE)
+		__WS_EVENT_NAME_CASE(THREAD_DELETE)
+		__WS_EVENT_NAME_CASE(THREAD_UPDATE)
+		break;
+	case 14:
+		__WS_EVENT_NAME_CASE(CHANNEL_CREATE)
+		__WS_EVENT_NAME_CASE(CHANNEL_DELETE)
+		__WS_EVENT_NAME_CASE(CHANNEL_UPDATE)
+		__WS_EVENT_NAME_CASE(MESSAGE_CREATE)
+		__WS_EVENT_NAME_CASE(MESSAGE_DELETE)
+		__WS_EVENT_NAME_CASE(MESSAGE_UPDATE)
+		break;
+	case 15:
+		__WS_EVENT_NAME_CASE(PRESENCE_UPDATE)
+		__WS_EVENT_NAME_CASE(WEBHOOKS_UPDATE)
+		break;
+	case 16:
+		__WS_EVENT_NAME_CASE(GUILD_BAN_REMOVE)
+		__WS_EVENT_NAME_CASE(GUILD_MEMBER_ADD)
+		__WS_EVENT_NAME_CASE(THREAD_LIST_SYNC)
+		break;
+	case 17:
+		__WS_EVENT_NAME_CASE(GUILD_ROLE_CREATE)
+		__WS_EVENT_NAME_CASE(GUILD_ROLE_DELETE)
+		__WS_EVENT_NAME_CASE(GUILD_ROLE_UPDATE)
+		__WS_EVENT_NAME_CASE(PRESENCES_REPLACE)
+		break;
+	case 18:
+		__WS_EVENT_NAME_CASE(INTEGRATION_CREATE)
+		__WS_EVENT_NAME_CASE(INTEGRATION_DELETE)
+		__WS_EVENT_NAME_CASE(INTEGRATION_UPDATE)
+		__WS_EVENT_NAME_CASE(INTERACTION_CREATE)
+		__WS_EVENT_NAME_CASE(VOICE_STATE_UPDATE)
+		break;
+	case 19:
+		__WS_EVENT_NAME_CASE(CHANNEL_PINS_UPDATE)
+		__WS_EVENT_NAME_CASE(GUILD_EMOJIS_UPDATE)
+		__WS_EVENT_NAME_CASE(GUILD_MEMBERS_CHUNK)
+		__WS_EVENT_NAME_CASE(GUILD_MEMBER_REMOVE)
+		__WS_EVENT_NAME_CASE(GUILD_MEMBER_UPDATE)
+		__WS_EVENT_NAME_CASE(MESSAGE_DELETE_BULK)
+		__WS_EVENT_NAME_CASE(VOICE_SERVER_UPDATE)
+		break;
+	case 20:
+		__WS_EVENT_NAME_CASE(MESSAGE_REACTION_ADD)
+		__WS_EVENT_NAME_CASE(THREAD_MEMBER_UPDATE)
+		break;
+	case 21:
+		__WS_EVENT_NAME_CASE(GUILD_STICKERS_UPDATE)
+		__WS_EVENT_NAME_CASE(STAGE_INSTANCE_CREATE)
+		__WS_EVENT_NAME_CASE(STAGE_INSTANCE_DELETE)
+		__WS_EVENT_NAME_CASE(STAGE_INSTANCE_REMOVE)
+		__WS_EVENT_NAME_CASE(STAGE_INSTANCE_UPDATE)
+		__WS_EVENT_NAME_CASE(THREAD_MEMBERS_UPDATE)
+		break;
+	case 23:
+		__WS_EVENT_NAME_CASE(MESSAGE_REACTION_REMOVE)
+		break;
+	case 25:
+		__WS_EVENT_NAME_CASE(GUILD_INTEGRATIONS_UPDATE)
+		break;
+	case 27:
+		__WS_EVENT_NAME_CASE(AUTO_MODERATION_RULE_CREATE)
+		__WS_EVENT_NAME_CASE(AUTO_MODERATION_RULE_DELETE)
+		__WS_EVENT_NAME_CASE(AUTO_MODERATION_RULE_UPDATE)
+		__WS_EVENT_NAME_CASE(MESSAGE_REACTION_REMOVE_ALL)
+		break;
+	case 28:
+		__WS_EVENT_NAME_CASE(GUILD_AUDIT_LOG_ENTRY_CREATE)
+		__WS_EVENT_NAME_CASE(GUILD_SCHEDULED_EVENT_CREATE)
+		__WS_EVENT_NAME_CASE(GUILD_SCHEDULED_EVENT_DELETE)
+		__WS_EVENT_NAME_CASE(GUILD_SCHEDULED_EVENT_UPDATE)
+		break;
+	case 29:
+		__WS_EVENT_NAME_CASE(MESSAGE_REACTION_REMOVE_EMOJI)
+		break;
+	case 30:
+		__WS_EVENT_NAME_CASE(GUILD_SCHEDULED_EVENT_USER_ADD)
+		break;
+	case 32:
+		__WS_EVENT_NAME_CASE(AUTO_MODERATION_ACTION_EXECUTION)
+		break;
+	case 33:
+		__WS_EVENT_NAME_CASE(GUILD_SCHEDULED_EVENT_USER_REMOVE)
+		break;
+	}
+
+#undef __WS_EVENT_NAME_CASE
+	return false;
+}
+
+int WebSocket::GetSubscribedIntents() const
+{
+	int intents = 0;
+	for (size_t i = 0; i != m_EventHandlers.size(); ++i)
+	{
+		if (m_EventHandlers[i].empty() && m_RawEventHandlers[i].empty())
+			continue;
+
+		switch (static_cast<Event>(i))
+		{
+		case Event::GUILD_CREATE:
+		case Event::GUILD_UPDATE:
+		case Event::GUILD_DELETE:
+		case Event::GUILD_ROLE_CREATE:
+		case Event::GUILD_ROLE_UPDATE:
+		case Event::GUILD_ROLE_DELETE:
+		case Event::CHANNEL_CREATE:
+		case Event::CHANNEL_UPDATE:
+		case Event::CHANNEL_DELETE:
+		case Event::CHANNEL_PINS_UPDATE:
+		case Event::THREAD_CREATE:
+		case Event::THREAD_UPDATE:
+		case Event::THREAD_DELETE:
+		case Event::THREAD_LIST_SYNC:
+		case Event::THREAD_MEMBER_UPDATE:
+		case Event::STAGE_INSTANCE_CREATE:
+		case Event::STAGE_INSTANCE_UPDATE:
+		case Event::STAGE_INSTANCE_REMOVE:
+		case Event::STAGE_INSTANCE_DELETE:
+			intents |= Intents::GUILDS;
+			break;
+		case Event::GUILD_MEMBER_ADD:
+		case Event::GUILD_MEMBER_UPDATE:
+		case Event::GUILD_MEMBER_REMOVE:
+		case Event::GUILD_MEMBERS_CHUNK:
+		case Event::THREAD_MEMBERS_UPDATE:
+			intents |= Intents::GUILD_MEMBERS;
+			break;
+		case Event::GUILD_AUDIT_LOG_ENTRY_CREATE:
+		case Event::GUILD_BAN_ADD:
+		case Event::GUILD_BAN_REMOVE:
+			intents |= Intents::GUILD_MODERATION;
+			break;
+		case Event::GUILD_EMOJIS_UPDATE:
+		case Event::GUILD_STICKERS_UPDATE:
+			intents |= Intents::GUILD_EMOJIS_AND_STICKERS;
+			break;
+		case Event::GUILD_INTEGRATIONS_UPDATE:
+		case Event::INTEGRATION_CREATE:
+		case Event::INTEGRATION_UPDATE:
+		case Event::INTEGRATION_DELETE:
+			intents |= Intents::GUILD_INTEGRATIONS;
+			break;
+		case Event::WEBHOOKS_UPDATE:
+			intents |= Intents::GUILD_WEBHOOKS;
+			break;
+		case Event::INVITE_CREATE:
+		case Event::INVITE_DELETE:
+			intents |= Intents::GUILD_INVITES;
+			break;
+		case Event::VOICE_STATE_UPDATE:
+			intents |= Intents::GUILD_VOICE_STATES;
+			break;
+		case Event::PRESENCE_UPDATE:
+			intents |= Intents::GUILD_PRESENCES;
+			break;
+		case Event::MESSAGE_CREATE:
+		case Event::MESSAGE_UPDATE:
+		case Event::MESSAGE_DELETE:
+		case Event::MESSAGE_DELETE_BULK:
+			intents |= Intents::GUILD_MESSAGES | Intents::DIRECT_MESSAGES
+				| Intents::MESSAGE_CONTENT;
+			break;
+		case Event::MESSAGE_REACTION_ADD:
+		case Event::MESSAGE_REACTION_REMOVE:
+		case Event::MESSAGE_REACTION_REMOVE_ALL:
+		case Event::MESSAGE_REACTION_REMOVE_EMOJI:
+			intents |= Intents::GUILD_MESSAGE_REACTIONS
+				| Intents::DIRECT_MESSAGE_REACTIONS;
+			break;
+		case Event::TYPING_START:
+			intents |= Intents::GUILD_MESSAGE_TYPING
+				| Intents::DIRECT_MESSAGE_TYPING;
+			break;
+		case Event::GUILD_SCHEDULED_EVENT_CREATE:
+		case Event::GUILD_SCHEDULED_EVENT_UPDATE:
+		case Event::GUILD_SCHEDULED_EVENT_DELETE:
+		case Event::GUILD_SCHEDULED_EVENT_USER_ADD:
+		case Event::GUILD_SCHEDULED_EVENT_USER_REMOVE:
+			intents |= Intents::GUILD_SCHEDULED_EVENTS;
+			break;
+		case Event::AUTO_MODERATION_RULE_CREATE:
+		case Event::AUTO_MODERATION_RULE_UPDATE:
+		case Event::AUTO_MODERATION_RULE_DELETE:
+			intents |= Intents::AUTO_MODERATION_CONFIGURATION;
+			break;
+		case Event::AUTO_MODERATION_ACTION_EXECUTION:
+			intents |= Intents::AUTO_MODERATION_EXECUTION;
+			break;
+		default:
+			// READY, RESUMED, USER_UPDATE, INTERACTION_CREATE, ...
+			break;
+		}
+	}
+	return intents;
+}
+
+void WebSocket::RequestGuildMembers(Snowflake const &guild_id)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::RequestGuildMembers");
 
-	Write(resume_payload.dump());
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter(payload)
+		.BeginObject()
+		.Int("op", 8)
+		.BeginObject("d")
+			.Id("guild_id", guild_id)
+			.String("query", "")
+			.Int("limit", 0)
+		.EndObject()
+		.EndObject();
+
+	Write(std::move(payload));
 }
 
-void WebSocket::RequestGuildMembers(std::string guild_id)
+void WebSocket::RequestGuildMembers(Snowflake const &guild_id,
+	std::vector<Snowflake> const &user_ids, std::string const &nonce)
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::RequestGuildMembers");
 
-	json payload = {
-		{ "op", 8 },
-		{ "d",{
-			{ "guild_id", guild_id },
-			{ "query", "" },
-			{ "limit", 0 }
-		} }
-	};
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter writer(payload);
+	writer.BeginObject()
+		.Int("op", 8)
+		.BeginObject("d")
+			.Id("guild_id", guild_id)
+			.BeginArray("user_ids");
+	for (auto const &user_id : user_ids)
+		writer.Id(user_id);
+	writer.EndArray()
+			.String("nonce", nonce)
+		.EndObject()
+		.EndObject();
+
+	Write(std::move(payload));
+}
 
-	Write(payload.dump());
+void WebSocket::SearchGuildMembers(Snowflake const &guild_id,
+	std::string const &query, unsigned int limit, std::string const &nonce)
+{
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::SearchGuildMembers");
+
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter(payload)
+		.BeginObject()
+		.Int("op", 8)
+		.BeginObject("d")
+			.Id("guild_id", guild_id)
+			.String("query", query)
+			.Int("limit", limit)
+			.String("nonce", nonce)
+		.EndObject()
+		.EndObject();
+
+	Write(std::move(payload));
 }
 
 void WebSocket::UpdateStatus(std::string const &status, std::string const &activity_name)
 {
 	Logger::Get()->Log(samplog_LogLevel::DEBUG, "WebSocket::UpdateStatus");
 
-	json payload = {
-		{ "op", 3 },
-		{ "d", {
-			{ "since", nullptr },
-			{ "game", nullptr },
-			{ "status", status },
-			{ "afk", false },
-		} }
-	};
-
-	if (!activity_name.empty())
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter writer(payload);
+	writer.BeginObject()
+		.Int("op", 3)
+		.BeginObject("d")
+			.Null("since");
+	if (activity_name.empty())
+	{
+		writer.Null("game");
+	}
+	else
 	{
-		payload.at("d").at("game") = {
-			{ "name", activity_name },
-			{ "type", 0 }
-		};
+		writer.BeginObject("game")
+			.String("name", activity_name)
+			.Int("type", 0)
+			.EndObject();
 	}
+	writer.String("status", status)
+			.Bool("afk", false)
+		.EndObject()
+		.EndObject();
 
-	Write(payload.dump());
+	Write(std::move(payload));
 }
 
 void WebSocket::DoHeartbeat(beast::error_code ec)
@@ -556,13 +1482,18 @@ void WebSocket::DoHeartbeat(beast::error_code ec)
 		return;
 	}
 
-	json heartbeat_payload = {
-		{ "op", 1 },
-		{ "d", _sequenceNumber }
-	};
+	// acks can't be read while reading is paused
+	if (!_heartbeatAcked && !_readPaused)
+	{
+		// the connection is dead without being closed ("zombied"), so we
+		// reconnect and resume the session
+		Logger::Get()->Log(samplog_LogLevel::WARNING,
+			"heartbeat was not acknowledged; attempting reconnect...");
+		Disconnect(true);
+		return;
+	}
 
-	Logger::Get()->Log(samplog_LogLevel::DEBUG, "sending heartbeat");
-	Write(heartbeat_payload.dump());
+	SendHeartbeat();
 
 	m_HeartbeatTimer.expires_from_now(m_HeartbeatInterval);
 	m_HeartbeatTimer.async_wait(
@@ -570,3 +1501,68 @@ void WebSocket::DoHeartbeat(beast::error_code ec)
 			&WebSocket::DoHeartbeat,
 			this));
 }
+
+void WebSocket::SendHeartbeat()
+{
+	std::string payload = AcquireWriteBuffer();
+	JsonWriter(payload)
+		.BeginObject()
+		.Int("op", 1)
+		.Int("d", _sequenceNumber)
+		.EndObject();
+
+	Logger::Get()->Log(samplog_LogLevel::DEBUG, "sending heartbeat");
+	Write(std::move(payload));
+
+	if (_heartbeatAcked)
+	{
+		_heartbeatAcked = false;
+		_heartbeatSendTime = std::chrono::steady_clock::now();
+	}
+}
+
+void WebSocket::RecordLatency(std::chrono::steady_clock::duration rtt)
+{
+	auto const rtt_ms = static_cast<unsigned int>(
+		std::chrono::duration_cast<std::chrono::milliseconds>(rtt).count());
+
+	size_t bucket = 0;
+	while (bucket < LATENCY_BUCKETS.size() && rtt_ms > LATENCY_BUCKETS[bucket])
+		++bucket;
+
+	std::lock_guard<std::mutex> lock(_latencyMutex);
+	_lastLatency = rtt_ms;
+	++_latencyHistogram[bucket];
+}
+
+bool WebSocket::GetLatency(unsigned int &last_ms,
+	unsigned int &median_ms, unsigned int &p99_ms) const
+{
+	std::lock_guard<std::mutex> lock(_latencyMutex);
+
+	unsigned int total = 0;
+	for (auto count : _latencyHistogram)
+		total += count;
+
+	if (total == 0)
+		return false;
+
+	// percentiles are reported as the upper bound of their bucket
+	auto get_percentile = [this, total](unsigned int percent)
+	{
+		unsigned int const rank = (total * percent + 99) / 100;
+		unsigned int count = 0;
+		for (size_t i = 0; i != LATENCY_BUCKETS.size(); ++i)
+		{
+			count += _latencyHistogram[i];
+			if (count >= rank)
+				return LATENCY_BUCKETS[i];
+		}
+		return std::max(LATENCY_BUCKETS.back(), _lastLatency);
+	};
+
+	last_ms = _lastLatency;
+	median_ms = get_percentile(50);
+	p99_ms = get_percentile(99);
+	return true;
+}
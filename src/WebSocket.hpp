@@ -3,11 +3,18 @@
 #include <string>
 #include <functional>
 #include <chrono>
-#include <map>
+#include <vector>
 #include <thread>
 #include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <array>
+#include <atomic>
 
 #include <json.hpp>
+#include "Snowflake.hpp"
 #include <boost/asio/strand.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
@@ -16,6 +23,7 @@
 #include <boost/beast/websocket/ssl.hpp>
 
 using json = nlohmann::json;
+class SessionState;
 namespace asio = boost::asio;
 namespace beast = boost::beast;
 
@@ -88,11 +96,28 @@ public:
 		AUTO_MODERATION_RULE_UPDATE,
 		AUTO_MODERATION_RULE_DELETE,
 		AUTO_MODERATION_ACTION_EXECUTION,
+
+		NUM_EVENTS
+	};
+	// handlers may take the payload by rvalue reference and move it into
+	// their dispatch task, each handler gets its own instance
+	using EventCallback_t = std::function<void(json &&)>;
+	// gets the whole unparsed payload, for events with their own decoder
+	using RawEventCallback_t = std::function<void(const char *payload, size_t length)>;
+
+	// payload envelope fields, read without parsing the whole payload
+	struct PayloadHeader
+	{
+		int Opcode = -1;
+		// points into the payload, not null-terminated
+		const char *EventName = "";
+		size_t EventNameLength = 0;
+		bool HasSequence = false;
+		uint64_t Sequence = 0;
 	};
-	using EventCallback_t = std::function<void(json const &)>;
 
 private:
-	WebSocket();
+	WebSocket(asio::io_context &io_context);
 
 public:
 	~WebSocket();
@@ -100,8 +125,10 @@ public:
 private: // variables
 	const int LARGE_THRESHOLD_NUMBER = 100;
 
-	asio::io_context _ioContext;
-	std::unique_ptr<std::thread> _netThread;
+	// the io_context is shared with the other network components, all
+	// handlers of this connection run on the strand so they never overlap
+	asio::strand<asio::io_context::executor_type> _strand;
+	bool _running = false;
 	asio::ip::tcp::resolver _resolver;
 	asio::ssl::context _sslContext;
 	using SslStream_t = beast::ssl_stream<beast::tcp_stream>;
@@ -112,19 +139,82 @@ private: // variables
 	asio::steady_timer _reconnectTimer;
 	unsigned int _reconnectCount = 0;
 
-	beast::multi_buffer _buffer;
+	// reading is paused while the Pawn dispatch queue is saturated
+	asio::steady_timer _readPauseTimer;
+	bool _readPaused = false;
+
+	// frames are read into one contiguous buffer, dispatch frames hand the
+	// whole buffer over to the decode thread which gives it back afterwards
+	beast::flat_buffer _buffer;
+	std::deque<std::string> _writeQueue;
+	// sent payloads are serialized into these again, keeping their capacity
+	std::vector<std::string> _writeBufferPool;
+	std::mutex _writeBufferPoolMutex;
+
+	// raw dispatch payloads waiting to be parsed and handled
+	struct DecodeQueueEntry
+	{
+		Event event;
+		beast::flat_buffer payload;
+	};
+	std::deque<DecodeQueueEntry> _decodeQueue;
+	std::vector<beast::flat_buffer> _bufferPool; // guarded by _decodeQueueMutex
+	std::mutex _decodeQueueMutex;
+	std::condition_variable _decodeQueueCondition;
+	bool
+		_stopDecoding = false,
+		_drainDecodeQueue = false;
+	std::unique_ptr<std::thread> _decodeThread;
+
+	// set while Shutdown waits for the connection to be closed
+	std::shared_ptr<std::promise<void>> _shutdownPromise;
+	bool
+		_shutdownClosed = false,
+		_readPending = false;
+
+	// set while recorded traffic is replayed on its own thread
+	bool _replaying = false;
+	std::atomic<bool> _stopReplay{ false };
+	std::mutex _replayMutex;
+	std::condition_variable _replayCondition; // wakes the replay thread up when stopping
+	std::unique_ptr<std::thread> _replayThread;
 
 	std::string _apiToken;
 	std::string _gatewayUrl;
+	std::string _resumeGatewayUrl;
+	std::string _host;
 	uint64_t _sequenceNumber = 0;
 	std::string m_SessionId;
 	asio::steady_timer m_HeartbeatTimer;
 	std::chrono::steady_clock::duration m_HeartbeatInterval;
-	std::multimap<Event, EventCallback_t> m_EventMap;
+	bool _heartbeatAcked = true;
+	std::chrono::steady_clock::time_point _heartbeatSendTime;
+
+	// heartbeat round-trip times; each bucket counts the RTTs up to its
+	// upper bound (in ms), the last histogram entry counts everything above
+	static const std::array<unsigned int, 12> LATENCY_BUCKETS;
+
+	static const size_t
+		READ_BUFFER_CAPACITY = 64 * 1024,
+		READ_BUFFER_SHRINK_THRESHOLD = 1024 * 1024,
+		READ_BUFFER_POOL_SIZE = 8,
+		WRITE_BUFFER_POOL_SIZE = 8;
+	std::array<unsigned int, 13> _latencyHistogram{};
+	unsigned int _lastLatency = 0;
+	mutable std::mutex _latencyMutex;
+	std::array<std::vector<EventCallback_t>,
+		static_cast<size_t>(Event::NUM_EVENTS)> m_EventHandlers;
+	std::array<std::vector<RawEventCallback_t>,
+		static_cast<size_t>(Event::NUM_EVENTS)> m_RawEventHandlers;
 	int _intents;
 
 private: // functions
 	void Initialize(std::string token, std::string gateway_url, int intents);
+	void Resume(std::string token, int intents, SessionState &&state);
+	void Replay(std::string const &file, double speed);
+	void Run();
+	// ends the session, has to be called while the io_context is still running
+	void Stop();
 
 	void Connect();
 	void OnResolve(beast::error_code ec,
@@ -134,27 +224,72 @@ private: // functions
 	void OnSslHandshake(beast::error_code ec);
 	void OnHandshake(beast::error_code ec);
 
-	void Disconnect(bool reconnect = false);
+	void Disconnect(bool reconnect = false, bool resumable = false);
+	// closes the connection and waits until none of its handlers is pending anymore
+	void Shutdown(bool resumable);
+	void FinishShutdown();
 	void OnClose(beast::error_code ec);
 	void OnReconnect(beast::error_code ec);
 
 	void Read();
+	void OnReadPause(beast::error_code ec);
 	void OnRead(beast::error_code ec,
 		std::size_t bytes_transferred);
 
-	void Write(std::string const &data);
+	bool GetDispatchEvent(PayloadHeader const &header, Event &dest) const;
+	void QueueEvent(Event event, beast::flat_buffer &&payload);
+	beast::flat_buffer AcquireReadBuffer();
+	void ReplayFrames(std::string const &file, double speed);
+
+	void ProcessDecodeQueue();
+	void StopDecoding(bool drain);
+	void DecodeEvent(Event event, beast::flat_buffer const &payload);
+	void ResetReadBuffer(beast::flat_buffer &buffer);
+	void RecycleReadBuffer(beast::flat_buffer &&buffer);
+
+	std::string AcquireWriteBuffer();
+	void Write(std::string data);
+	void DoWrite();
 	void OnWrite(beast::error_code ec,
 		size_t bytes_transferred);
 
+	static bool ParseEventName(const char *name, size_t length, Event &dest);
+
 	void Identify();
 	void SendResumePayload();
 	void DoHeartbeat(beast::error_code ec);
+	void SendHeartbeat();
+	void RecordLatency(std::chrono::steady_clock::duration rtt);
 
 public: // functions
 	void RegisterEvent(Event event, EventCallback_t &&callback)
 	{
-		m_EventMap.emplace(event, std::move(callback));
+		m_EventHandlers[static_cast<size_t>(event)].push_back(std::move(callback));
 	}
-	void RequestGuildMembers(std::string guild_id);
+	// the payload is only parsed into a JSON tree if there are also
+	// handlers registered with RegisterEvent
+	void RegisterRawEvent(Event event, RawEventCallback_t &&callback)
+	{
+		m_RawEventHandlers[static_cast<size_t>(event)].push_back(std::move(callback));
+	}
+	// Closes the connection without invalidating the session and waits until
+	// all received events are handled. Returns false if there's no session
+	// that could be resumed later on.
+	bool Suspend(SessionState &dest);
+
+	// round-trip time of the last heartbeat and the median and 99th percentile
+	// of all heartbeats so far; returns false if no heartbeat was acknowledged yet
+	bool GetLatency(unsigned int &last_ms,
+		unsigned int &median_ms, unsigned int &p99_ms) const;
+
+	// union of the gateway intents required by all registered events
+	int GetSubscribedIntents() const;
+
+	void RequestGuildMembers(Snowflake const &guild_id);
+	// members are delivered in GUILD_MEMBERS_CHUNK events carrying the nonce
+	void RequestGuildMembers(Snowflake const &guild_id,
+		std::vector<Snowflake> const &user_ids, std::string const &nonce);
+	void SearchGuildMembers(Snowflake const &guild_id,
+		std::string const &query, unsigned int limit, std::string const &nonce);
 	void UpdateStatus(std::string const &status, std::string const &activity_name);
 };
@@ -0,0 +1,166 @@
+// Times the construction of a guild from a synthetic GUILD_CREATE payload
+// for growing member counts. Ingestion is linear if the time per member
+// stays about the same from the smallest to the largest guild.
+// Every size is measured a few times and the fastest run counts, the
+// global user and channel caches keep growing over the runs though.
+//
+// Built with -DDCC_BUILD_BENCHMARKS=ON, run without arguments.
+
+#include "sdk.hpp"
+#include "Guild.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <memory>
+
+#include <json.hpp>
+
+
+using json = nlohmann::json;
+
+// normally set by the server when the plugin is loaded
+logprintf_t logprintf = nullptr;
+
+namespace
+{
+	const unsigned int
+		NUM_ROLES = 50,
+		NUM_TEXT_CHANNELS = 20,
+		NUM_VOICE_CHANNELS = 10;
+
+	// every guild gets its own id range, so users and channels of earlier
+	// runs aren't found in the caches
+	std::string MakeId(unsigned int run, unsigned int kind, unsigned int index)
+	{
+		return std::to_string(100000000000000000ULL
+			+ run * 10000000000ULL + kind * 1000000000ULL + index);
+	}
+
+	json MakeGuildCreate(unsigned int run, unsigned int member_count)
+	{
+		enum { GUILD, ROLE, CHANNEL, USER };
+
+		json roles = json::array();
+		for (unsigned int i = 0; i != NUM_ROLES; ++i)
+		{
+			roles.push_back({
+				{ "id", MakeId(run, ROLE, i) },
+				{ "name", "role " + std::to_string(i) },
+				{ "color", 0 },
+				{ "hoist", false },
+				{ "position", i },
+				{ "permissions", "1024" },
+				{ "mentionable", false }
+			});
+		}
+
+		json channels = json::array();
+		for (unsigned int i = 0; i != NUM_TEXT_CHANNELS + NUM_VOICE_CHANNELS; ++i)
+		{
+			channels.push_back({
+				{ "id", MakeId(run, CHANNEL, i) },
+				{ "type", i < NUM_TEXT_CHANNELS ? 0 : 2 },
+				{ "name", "channel " + std::to_string(i) },
+				{ "position", i },
+				{ "nsfw", false },
+				{ "parent_id", nullptr },
+				{ "permission_overwrites", json::array() }
+			});
+		}
+
+		static const char *statuses[] = { "online", "idle", "dnd" };
+
+		json
+			members = json::array(),
+			presences = json::array(),
+			voice_states = json::array();
+		for (unsigned int i = 0; i != member_count; ++i)
+		{
+			auto const user_id = MakeId(run, USER, i);
+			members.push_back({
+				{ "user", {
+					{ "id", user_id },
+					{ "username", "user" + std::to_string(i) },
+					{ "discriminator", "0001" },
+					{ "bot", false }
+				} },
+				{ "nick", i % 4 == 0 ? json("nick" + std::to_string(i)) : json(nullptr) },
+				{ "roles", { MakeId(run, ROLE, i % NUM_ROLES), MakeId(run, ROLE, (i * 7) % NUM_ROLES) } }
+			});
+
+			// about a third is online, as in GUILD_CREATE of a large guild
+			if (i % 3 == 0)
+			{
+				presences.push_back({
+					{ "user", { { "id", user_id } } },
+					{ "status", statuses[i % 9 / 3] }
+				});
+			}
+			if (i % 100 == 0)
+			{
+				voice_states.push_back({
+					{ "user_id", user_id },
+					{ "channel_id", MakeId(run, CHANNEL, NUM_TEXT_CHANNELS + i % NUM_VOICE_CHANNELS) }
+				});
+			}
+		}
+
+		return {
+			{ "id", MakeId(run, GUILD, 0) },
+			{ "name", "benchmark guild" },
+			{ "owner_id", MakeId(run, USER, 0) },
+			{ "member_count", member_count },
+			{ "roles", std::move(roles) },
+			{ "channels", std::move(channels) },
+			{ "members", std::move(members) },
+			{ "presences", std::move(presences) },
+			{ "voice_states", std::move(voice_states) }
+		};
+	}
+}
+
+int main()
+{
+	static const unsigned int member_counts[] = { 10000, 25000, 50000, 100000 };
+	const unsigned int NUM_REPETITIONS = 3;
+
+	std::printf("%10s %12s %14s\n", "members", "total ms", "us per member");
+
+	double first_per_member = 0.0, last_per_member = 0.0;
+	unsigned int run = 0;
+	for (auto const member_count : member_counts)
+	{
+		double ms = 0.0;
+		for (unsigned int i = 0; i != NUM_REPETITIONS; ++i)
+		{
+			json const data = MakeGuildCreate(++run, member_count);
+
+			auto const start = std::chrono::steady_clock::now();
+			std::unique_ptr<Guild> guild(new Guild(static_cast<GuildId_t>(run), data));
+			auto const duration = std::chrono::steady_clock::now() - start;
+
+			if (guild->GetMembers().size() != member_count)
+			{
+				std::printf("expected %u members, got %u\n",
+					member_count, static_cast<unsigned int>(guild->GetMembers().size()));
+				return 1;
+			}
+
+			double const run_ms = std::chrono::duration<double, std::milli>(duration).count();
+			if (i == 0 || run_ms < ms)
+				ms = run_ms;
+		}
+
+		double const per_member = ms * 1000.0 / member_count;
+		std::printf("%10u %12.1f %14.3f\n", member_count, ms, per_member);
+
+		if (first_per_member == 0.0)
+			first_per_member = per_member;
+		last_per_member = per_member;
+	}
+
+	std::printf("time per member at %u vs %u members: %.2fx\n",
+		member_counts[3], member_counts[0], last_per_member / first_per_member);
+	return 0;
+}
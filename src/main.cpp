@@ -8,27 +8,60 @@
 #include "Message.hpp"
 #include "Command.hpp"
 #include "SampConfigReader.hpp"
+#include "Intents.hpp"
+#include "SessionState.hpp"
+#include "GatewayRecorder.hpp"
+#include "misc.hpp"
 #include "Logger.hpp"
 #include "version.hpp"
 
 #include <samplog/samplog.hpp>
 #include <thread>
 #include <cstdlib>
+#include <vector>
 #include <sdk.hpp>
 #include <Server/Components/Pawn/pawn.hpp>
 
 extern void	*pAMXFunctions;
 logprintf_t logprintf;
-#define ALL_INTENTS 131071
 
-void InitializeEverything(std::string const &bot_token, int intents)
+void InitializeEverything(std::string const &bot_token, int intents,
+	bool lazy_members, unsigned int network_threads,
+	std::vector<std::string> const &script_files)
 {
-	GuildManager::Get()->Initialize();
+	Network::Get()->Start(network_threads);
+
+	GuildManager::Get()->Initialize(lazy_members);
 	UserManager::Get()->Initialize();
 	ChannelManager::Get()->Initialize();
 	MessageManager::Get()->Initialize();
 	CommandManager::Get()->Initialize();
-	Network::Get()->Initialize(bot_token, intents);
+
+	if (GatewayRecorder::Get()->IsReplaying())
+	{
+		Network::Get()->Replay(bot_token,
+			GatewayRecorder::Get()->GetReplayFile(), GatewayRecorder::Get()->GetReplaySpeed());
+		return;
+	}
+
+	if (intents == Intents::AUTO)
+	{
+		intents = Intents::Resolve(
+			Network::Get()->WebSocket().GetSubscribedIntents(), script_files);
+		Logger::Get()->Log(samplog_LogLevel::INFO,
+			"using derived gateway intents '{:d}'", intents);
+	}
+
+	SessionState session;
+	if (session.Load(bot_token, intents))
+	{
+		Logger::Get()->Log(samplog_LogLevel::INFO, "resuming saved gateway session");
+		Network::Get()->Resume(bot_token, intents, std::move(session));
+	}
+	else
+	{
+		Network::Get()->Initialize(bot_token, intents);
+	}
 }
 
 void DestroyEverything()
@@ -40,6 +73,14 @@ void DestroyEverything()
 	Network::Singleton::Destroy();
 }
 
+bool IsEverythingInitialized()
+{
+	return GuildManager::Get()->IsInitialized()
+		&& UserManager::Get()->IsInitialized()
+		&& ChannelManager::Get()->IsInitialized()
+		&& CommandManager::Get()->IsInitialized();
+}
+
 bool WaitForInitialization()
 {
 	unsigned int const
@@ -48,13 +89,8 @@ bool WaitForInitialization()
 	unsigned int waited_time = 0;
 	while (true)
 	{
-		if (GuildManager::Get()->IsInitialized()
-			&& UserManager::Get()->IsInitialized()
-			&& ChannelManager::Get()->IsInitialized()
-			&& CommandManager::Get()->IsInitialized())
-		{
+		if (IsEverythingInitialized())
 			return true;
-		}
 
 		std::this_thread::sleep_for(std::chrono::milliseconds(SLEEP_TIME_MS));
 		waited_time += SLEEP_TIME_MS;
@@ -64,6 +100,30 @@ bool WaitForInitialization()
 	return false;
 }
 
+// saves the gateway session so that it can be resumed after a quick restart
+void SuspendEverything()
+{
+	if (!IsEverythingInitialized())
+		return;
+
+	SessionState session;
+	if (!Network::Get()->WebSocket().Suspend(session))
+		return;
+
+	// the scripts are already unloaded, so queued tasks can't run anymore;
+	// without their cache updates the snapshot would miss events that are
+	// already counted in the sequence number, so don't save it at all
+	if (PawnDispatcher::Get()->HasPendingTasks())
+	{
+		Logger::Get()->Log(samplog_LogLevel::INFO,
+			"not saving gateway session, there are still unprocessed events");
+		return;
+	}
+
+	session.CaptureCache();
+	session.Save();
+}
+
 std::string GetEnvironmentVar(const char *key)
 {
 	const char *value = getenv(key);
@@ -81,29 +141,52 @@ PLUGIN_EXPORT bool PLUGIN_CALL Load(void **ppData)
 	logprintf = (logprintf_t)ppData[PLUGIN_DATA_LOGPRINTF];
 
 	bool ret_val = true;
-	int intents = ALL_INTENTS;
+	int intents = Intents::AUTO;
 	auto bot_intentsStr = GetEnvironmentVar("DCC_BOT_INTENTS");
-	if (!bot_intentsStr.empty())
-	{
-		try
-		{
-			intents = std::stoi(bot_intentsStr);
-		}
-		catch (...)
-		{
-			intents = ALL_INTENTS;
-		}
-	}
-	else if (bot_intentsStr.empty())
-	{
+	if (bot_intentsStr.empty())
 		SampConfigReader::Get()->GetVar("discord_bot_intents", bot_intentsStr);
-		try
-		{
-			intents = std::stoi(bot_intentsStr);
-		}
-		catch (...)
+	if (!Intents::Parse(bot_intentsStr, intents))
+		intents = Intents::ALL;
+
+	auto lazy_membersStr = GetEnvironmentVar("DCC_LAZY_MEMBERS");
+	if (lazy_membersStr.empty())
+		SampConfigReader::Get()->GetVar("discord_lazy_members", lazy_membersStr);
+	bool const lazy_members = lazy_membersStr == "1" || lazy_membersStr == "true";
+
+	auto gateway_record = GetEnvironmentVar("DCC_GATEWAY_RECORD");
+	if (gateway_record.empty())
+		SampConfigReader::Get()->GetVar("discord_gateway_record", gateway_record);
+	auto gateway_replay = GetEnvironmentVar("DCC_GATEWAY_REPLAY");
+	if (gateway_replay.empty())
+		SampConfigReader::Get()->GetVar("discord_gateway_replay", gateway_replay);
+	auto gateway_replay_speedStr = GetEnvironmentVar("DCC_GATEWAY_REPLAY_SPEED");
+	if (gateway_replay_speedStr.empty())
+		SampConfigReader::Get()->GetVar("discord_gateway_replay_speed", gateway_replay_speedStr);
+	double gateway_replay_speed = 1.0;
+	if (!gateway_replay_speedStr.empty())
+		ConvertStrToData(gateway_replay_speedStr, gateway_replay_speed);
+	GatewayRecorder::Get()->Configure(gateway_record, gateway_replay, gateway_replay_speed);
+
+	unsigned int network_threads = Network::DEFAULT_THREAD_COUNT;
+	auto network_threadsStr = GetEnvironmentVar("DCC_NETWORK_THREADS");
+	if (network_threadsStr.empty())
+		SampConfigReader::Get()->GetVar("discord_network_threads", network_threadsStr);
+	if (!network_threadsStr.empty())
+		ConvertStrToData(network_threadsStr, network_threads);
+
+	std::vector<std::string> script_files;
+	if (intents == Intents::AUTO)
+	{
+		std::vector<std::string> scripts;
+		SampConfigReader::Get()->GetGamemodeList(scripts);
+		for (auto const &gm : scripts)
+			script_files.push_back("gamemodes/" + gm + ".amx");
+
+		SampConfigReader::Get()->GetVarList("filterscripts", scripts);
+		for (auto const &fs : scripts)
 		{
-			intents = ALL_INTENTS;
+			if (!fs.empty())
+				script_files.push_back("filterscripts/" + fs + ".amx");
 		}
 	}
 
@@ -122,7 +205,7 @@ PLUGIN_EXPORT bool PLUGIN_CALL Load(void **ppData)
 
 	if (!bot_token.empty())
 	{
-		InitializeEverything(bot_token, intents);
+		InitializeEverything(bot_token, intents, lazy_members, network_threads, script_files);
 
 		if (WaitForInitialization())
 		{
@@ -132,14 +215,14 @@ PLUGIN_EXPORT bool PLUGIN_CALL Load(void **ppData)
 		{
 			logprintf(" >> discord-connector: timeout while initializing data.");
 
-			std::thread init_thread([bot_token, intents]()
+			std::thread init_thread([bot_token, intents, lazy_members, network_threads, script_files]()
 			{
 				while (true)
 				{
 					std::this_thread::sleep_for(std::chrono::minutes(1));
 
 					DestroyEverything();
-					InitializeEverything(bot_token, intents);
+					InitializeEverything(bot_token, intents, lazy_members, network_threads, script_files);
 					if (WaitForInitialization())
 						break;
 				}
@@ -161,7 +244,9 @@ PLUGIN_EXPORT void PLUGIN_CALL Unload()
 {
 	logprintf("discord-connector: Unloading plugin...");
 
+	SuspendEverything();
 	DestroyEverything();
+	GatewayRecorder::Singleton::Destroy();
 	Logger::Singleton::Destroy();
 
 	samplog::Api::Destroy();
@@ -172,6 +257,7 @@ PLUGIN_EXPORT void PLUGIN_CALL Unload()
 PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 {
 	PawnDispatcher::Get()->Process();
+	GuildManager::Get()->ExpireMemberRequests();
 }
 
 
@@ -242,6 +328,10 @@ extern "C" const AMX_NATIVE_INFO native_list[] =
 	AMX_DEFINE_NATIVE(DCC_GetGuildMemberRoleCount)
 	AMX_DEFINE_NATIVE(DCC_HasGuildMemberRole)
 	AMX_DEFINE_NATIVE(DCC_GetGuildMemberStatus)
+	AMX_DEFINE_NATIVE(DCC_GetMemberPermissions)
+	AMX_DEFINE_NATIVE(DCC_QueryGuildMembers)
+	AMX_DEFINE_NATIVE(DCC_GetGuildOnlineCount)
+	AMX_DEFINE_NATIVE(DCC_GetVoiceChannelMembers)
 	AMX_DEFINE_NATIVE(DCC_GetGuildChannel)
 	AMX_DEFINE_NATIVE(DCC_GetGuildChannelCount)
 	AMX_DEFINE_NATIVE(DCC_GetAllGuilds)
@@ -255,6 +345,10 @@ extern "C" const AMX_NATIVE_INFO native_list[] =
 	AMX_DEFINE_NATIVE(DCC_RemoveGuildMember)
 	AMX_DEFINE_NATIVE(DCC_CreateGuildMemberBan)
 	AMX_DEFINE_NATIVE(DCC_RemoveGuildMemberBan)
+	AMX_DEFINE_NATIVE(DCC_RequestGuildMember)
+	AMX_DEFINE_NATIVE(DCC_SearchGuildMembers)
+	AMX_DEFINE_NATIVE(DCC_GetRequestedMemberCount)
+	AMX_DEFINE_NATIVE(DCC_GetRequestedMember)
 	AMX_DEFINE_NATIVE(DCC_SetGuildRolePosition)
 	AMX_DEFINE_NATIVE(DCC_SetGuildRoleName)
 	AMX_DEFINE_NATIVE(DCC_SetGuildRolePermissions)
@@ -272,6 +366,7 @@ extern "C" const AMX_NATIVE_INFO native_list[] =
 	AMX_DEFINE_NATIVE(DCC_GetCreatedPrivateChannel)
 	AMX_DEFINE_NATIVE(DCC_SetBotPresenceStatus)
 	AMX_DEFINE_NATIVE(DCC_SetBotActivity)
+	AMX_DEFINE_NATIVE(DCC_GetGatewayLatency)
 
 	AMX_DEFINE_NATIVE(DCC_EscapeMarkdown)
 
@@ -361,30 +456,77 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 		logprintf = DiscordComponent::logprintfwrapped;
 
 		bool ret_val = true;
-		int intents = ALL_INTENTS;
+		int intents = Intents::AUTO;
 		auto bot_intentsStr = GetEnvironmentVar("DCC_BOT_INTENTS");
 		if (!bot_intentsStr.empty())
 		{
-			try
-			{
-				intents = std::stoi(bot_intentsStr);
-			}
-			catch (...)
-			{
-				intents = ALL_INTENTS;
-			}
+			if (!Intents::Parse(bot_intentsStr, intents))
+				intents = Intents::ALL;
 		}
-		else if (bot_intentsStr.empty())
+		else
 		{
 			auto intents_config = core->getConfig().getInt("discord.intents");
-			if (!intents_config)
-			{
-				intents = ALL_INTENTS;
-			}
-			else
-			{
+			if (intents_config)
 				intents = *intents_config;
-			}
+		}
+
+		bool lazy_members = false;
+		auto lazy_membersStr = GetEnvironmentVar("DCC_LAZY_MEMBERS");
+		if (!lazy_membersStr.empty())
+		{
+			lazy_members = lazy_membersStr == "1" || lazy_membersStr == "true";
+		}
+		else
+		{
+			auto lazy_members_config = core->getConfig().getBool("discord.lazy_members");
+			if (lazy_members_config)
+				lazy_members = *lazy_members_config;
+		}
+
+		auto gateway_record = GetEnvironmentVar("DCC_GATEWAY_RECORD");
+		if (gateway_record.empty())
+		{
+			auto gateway_record_config = core->getConfig().getString("discord.gateway_record");
+			gateway_record.assign(gateway_record_config.data(), gateway_record_config.length());
+		}
+		auto gateway_replay = GetEnvironmentVar("DCC_GATEWAY_REPLAY");
+		if (gateway_replay.empty())
+		{
+			auto gateway_replay_config = core->getConfig().getString("discord.gateway_replay");
+			gateway_replay.assign(gateway_replay_config.data(), gateway_replay_config.length());
+		}
+		double gateway_replay_speed = 1.0;
+		auto gateway_replay_speedStr = GetEnvironmentVar("DCC_GATEWAY_REPLAY_SPEED");
+		if (!gateway_replay_speedStr.empty())
+		{
+			ConvertStrToData(gateway_replay_speedStr, gateway_replay_speed);
+		}
+		else
+		{
+			auto gateway_replay_speed_config = core->getConfig().getFloat("discord.gateway_replay_speed");
+			if (gateway_replay_speed_config)
+				gateway_replay_speed = *gateway_replay_speed_config;
+		}
+		GatewayRecorder::Get()->Configure(gateway_record, gateway_replay, gateway_replay_speed);
+
+		unsigned int network_threads = Network::DEFAULT_THREAD_COUNT;
+		auto network_threadsStr = GetEnvironmentVar("DCC_NETWORK_THREADS");
+		if (!network_threadsStr.empty())
+		{
+			ConvertStrToData(network_threadsStr, network_threads);
+		}
+		else
+		{
+			auto network_threads_config = core->getConfig().getInt("discord.network_threads");
+			if (network_threads_config && *network_threads_config > 0)
+				network_threads = static_cast<unsigned int>(*network_threads_config);
+		}
+
+		std::vector<std::string> script_files;
+		if (intents == Intents::AUTO)
+		{
+			GetScriptFiles("pawn.main_scripts", "gamemodes/", script_files);
+			GetScriptFiles("pawn.side_scripts", "", script_files);
 		}
 
 		auto bot_token = GetEnvironmentVar("DCC_BOT_TOKEN");
@@ -407,7 +549,7 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 
 		if (!bot_token.empty())
 		{
-			InitializeEverything(bot_token.data(), intents);
+			InitializeEverything(bot_token.data(), intents, lazy_members, network_threads, script_files);
 
 			if (WaitForInitialization())
 			{
@@ -417,14 +559,14 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 			{
 				logprintf(" >> discord-connector: timeout while initializing data.");
 
-				std::thread init_thread([bot_token, intents]()
+				std::thread init_thread([bot_token, intents, lazy_members, network_threads, script_files]()
 					{
 						while (true)
 						{
 							std::this_thread::sleep_for(std::chrono::minutes(1));
 
 							DestroyEverything();
-							InitializeEverything(bot_token.data(), intents);
+							InitializeEverything(bot_token.data(), intents, lazy_members, network_threads, script_files);
 							if (WaitForInitialization())
 								break;
 						}
@@ -441,6 +583,23 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 		}
 	}
 
+	// script entries are of the form "name [count]", without file extension
+	static void GetScriptFiles(StringView key, std::string const &directory,
+		std::vector<std::string> &dest)
+	{
+		auto &config = core->getConfig();
+		std::vector<StringView> scripts(config.getStringsCount(key));
+		config.getStrings(key, Span<StringView>(scripts.data(), scripts.size()));
+
+		for (auto const &script : scripts)
+		{
+			std::string name(script.data(), script.length());
+			name.erase(std::min(name.find(' '), name.length()));
+			if (!name.empty())
+				dest.push_back(directory + name + ".amx");
+		}
+	}
+
 	void onInit(IComponentList* components) override
 	{
 		pawnComponent = components->queryComponent<IPawnComponent>();
@@ -488,7 +647,9 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 
 		logprintf("discord-connector: Unloading componment...");
 
+		SuspendEverything();
 		DestroyEverything();
+		GatewayRecorder::Singleton::Destroy();
 		Logger::Singleton::Destroy();
 
 		samplog::Api::Destroy();
@@ -507,7 +668,12 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 		if (defaults)
 		{
 			config.setString("discord.bot_token", "");
-			config.setInt("discord.intents", ALL_INTENTS);
+			config.setInt("discord.intents", Intents::AUTO);
+			config.setBool("discord.lazy_members", false);
+			config.setInt("discord.network_threads", Network::DEFAULT_THREAD_COUNT);
+			config.setString("discord.gateway_record", "");
+			config.setString("discord.gateway_replay", "");
+			config.setFloat("discord.gateway_replay_speed", 1.0f);
 		}
 		else
 		{
@@ -518,7 +684,32 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 
 			if (config.getType("discord.intents") == ConfigOptionType_None)
 			{
-				config.setInt("discord.intents", ALL_INTENTS);
+				config.setInt("discord.intents", Intents::AUTO);
+			}
+
+			if (config.getType("discord.lazy_members") == ConfigOptionType_None)
+			{
+				config.setBool("discord.lazy_members", false);
+			}
+
+			if (config.getType("discord.network_threads") == ConfigOptionType_None)
+			{
+				config.setInt("discord.network_threads", Network::DEFAULT_THREAD_COUNT);
+			}
+
+			if (config.getType("discord.gateway_record") == ConfigOptionType_None)
+			{
+				config.setString("discord.gateway_record", "");
+			}
+
+			if (config.getType("discord.gateway_replay") == ConfigOptionType_None)
+			{
+				config.setString("discord.gateway_replay", "");
+			}
+
+			if (config.getType("discord.gateway_replay_speed") == ConfigOptionType_None)
+			{
+				config.setFloat("discord.gateway_replay_speed", 1.0f);
 			}
 		}
 	}
@@ -526,6 +717,7 @@ class DiscordComponent : public IComponent, public PawnEventHandler, public Core
 	void onTick(Microseconds elapsed, TimePoint now) override
 	{
 		PawnDispatcher::Get()->Process();
+		GuildManager::Get()->ExpireMemberRequests();
 	}
 };
 
@@ -33,13 +33,14 @@ AMX_DECLARE_NATIVE(Native::native_name)
 }
 */
 
-// native DCC_Channel:DCC_FindChannelByName(const channel_name[]);
+// native DCC_Channel:DCC_FindChannelByName(const channel_name[], bool:case_sensitive = true);
 AMX_DECLARE_NATIVE(Native::DCC_FindChannelByName)
 {
-	ScopedDebugInfo dbg_info(amx, "DCC_FindChannelByName", params, "s");
+	ScopedDebugInfo dbg_info(amx, "DCC_FindChannelByName", params, "sd");
 
 	std::string const channel_name = amx_GetCppString(amx, params[1]);
-	Channel_t const &channel = ChannelManager::Get()->FindChannelByName(channel_name);
+	bool const case_sensitive = params[0] / sizeof(cell) < 2 || params[2] != 0;
+	Channel_t const &channel = ChannelManager::Get()->FindChannelByName(channel_name, case_sensitive);
 
 	cell ret_val = channel ? channel->GetPawnId() : 0;
 
@@ -74,7 +75,7 @@ AMX_DECLARE_NATIVE(Native::DCC_GetChannelId)
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[2], channel->GetId(), params[3]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[2], channel->GetId().ToString(), params[3]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -463,7 +464,7 @@ AMX_DECLARE_NATIVE(Native::DCC_GetMessageId)
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[2], msg->GetId(), params[3]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[2], msg->GetId().ToString(), params[3]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -746,15 +747,16 @@ AMX_DECLARE_NATIVE(Native::DCC_GetCreatedMessage)
 	return ret_val;
 }
 
-// native DCC_User:DCC_FindUserByName(const user_name[], const user_discriminator[]);
+// native DCC_User:DCC_FindUserByName(const user_name[], const user_discriminator[], bool:case_sensitive = true);
 AMX_DECLARE_NATIVE(Native::DCC_FindUserByName)
 {
-	ScopedDebugInfo dbg_info(amx, "DCC_FindUserByName", params, "ss");
+	ScopedDebugInfo dbg_info(amx, "DCC_FindUserByName", params, "ssd");
 
 	std::string const
 		user_name = amx_GetCppString(amx, params[1]),
 		discriminator = amx_GetCppString(amx, params[2]);
-	User_t const &user = UserManager::Get()->FindUserByName(user_name, discriminator);
+	bool const case_sensitive = params[0] / sizeof(cell) < 3 || params[3] != 0;
+	User_t const &user = UserManager::Get()->FindUserByName(user_name, discriminator, case_sensitive);
 
 	cell ret_val = user ? user->GetPawnId() : 0;
 
@@ -789,7 +791,7 @@ AMX_DECLARE_NATIVE(Native::DCC_GetUserId)
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[2], user->GetId(), params[3]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[2], user->GetId().ToString(), params[3]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -885,10 +887,10 @@ AMX_DECLARE_NATIVE(Native::DCC_IsUserVerified)
 	return 1;
 }
 
-// native DCC_Role:DCC_FindRoleByName(DCC_Guild:guild, const role_name[]);
+// native DCC_Role:DCC_FindRoleByName(DCC_Guild:guild, const role_name[], bool:case_sensitive = true);
 AMX_DECLARE_NATIVE(Native::DCC_FindRoleByName)
 {
-	ScopedDebugInfo dbg_info(amx, "DCC_FindRoleByName", params, "ds");
+	ScopedDebugInfo dbg_info(amx, "DCC_FindRoleByName", params, "dsd");
 
 	GuildId_t guildid = params[1];
 	std::string const role_name = amx_GetCppString(amx, params[2]);
@@ -900,19 +902,8 @@ AMX_DECLARE_NATIVE(Native::DCC_FindRoleByName)
 		return INVALID_ROLE_ID;
 	}
 
-	cell ret_val = INVALID_ROLE_ID;
-	for (auto const &r : guild->GetRoles())
-	{
-		Role_t const &role = RoleManager::Get()->FindRole(r);
-		if (!role)
-			continue;
-
-		if (role->GetName() == role_name)
-		{
-			ret_val = role->GetPawnId();
-			break;
-		}
-	}
+	bool const case_sensitive = params[0] / sizeof(cell) < 3 || params[3] != 0;
+	cell ret_val = guild->FindRoleByName(role_name, case_sensitive);
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -945,7 +936,7 @@ AMX_DECLARE_NATIVE(Native::DCC_GetRoleId)
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[2], role->GetId(), params[3]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[2], role->GetId().ToString(), params[3]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -1150,7 +1141,7 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildId)
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[2], guild->GetId(), params[3]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[2], guild->GetId().ToString(), params[3]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -1188,7 +1179,7 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildOwnerId)
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[2], guild->GetOwnerId(), params[3]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[2], guild->GetOwnerId().ToString(), params[3]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -1333,25 +1324,24 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberVoiceChannel)
 
 	UserId_t user_id = params[2];
 
-	for (auto &m : guild->GetMembers())
+	auto const *member = guild->FindMember(user_id);
+	if (member == nullptr)
 	{
-		if (m.UserId != user_id)
-			continue;
-
-		cell *dest = nullptr;
-		if (amx_GetAddr(amx, params[3], &dest) != AMX_ERR_NONE || dest == nullptr)
-		{
-			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
-			return 0;
-		}
+		if (!guild->RequestMissingMember(user_id))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user id '{}'", user_id);
+		return 0;
+	}
 
-		*dest = static_cast<cell>(m.GetVoiceChannel());
-		Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
-		return 1;
+	cell *dest = nullptr;
+	if (amx_GetAddr(amx, params[3], &dest) != AMX_ERR_NONE || dest == nullptr)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
+		return 0;
 	}
 
-	Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user id '{}'", user_id);
-	return 0;
+	*dest = static_cast<cell>(member->GetVoiceChannel());
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
+	return 1;
 }
 
 // native DCC_GetGuildMemberNickname(DCC_Guild:guild, DCC_User:user, dest[], max_size = sizeof dest);
@@ -1368,25 +1358,15 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberNickname)
 	}
 
 	UserId_t userid = params[2];
-	std::string nick;
-	bool member_found = false;
-	for (auto &m : guild->GetMembers())
+	auto const *member = guild->FindMember(userid);
+	if (member == nullptr)
 	{
-		if (m.UserId != userid)
-			continue;
-
-		nick = m.Nickname;
-		member_found = true;
-		break;
-	}
-
-	if (!member_found)
-	{
-		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		if (!guild->RequestMissingMember(userid))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
 		return 0;
 	}
 
-	cell ret_val = amx_SetCppString(amx, params[3], nick, params[4]) == AMX_ERR_NONE;
+	cell ret_val = amx_SetCppString(amx, params[3], member->Nickname, params[4]) == AMX_ERR_NONE;
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
 	return ret_val;
@@ -1406,19 +1386,12 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberRole)
 	}
 
 	UserId_t userid = params[2];
-	std::vector<RoleId_t> const *roles = nullptr;
-	for (auto &m : guild->GetMembers())
-	{
-		if (m.UserId != userid)
-			continue;
-
-		roles = &m.Roles;
-		break;
-	}
-
+	auto const *member = guild->FindMember(userid);
+	std::vector<RoleId_t> const *roles = member != nullptr ? &member->Roles : nullptr;
 	if (roles == nullptr)
 	{
-		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		if (!guild->RequestMissingMember(userid))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
 		return 0;
 	}
 
@@ -1458,19 +1431,12 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberRoleCount)
 	}
 
 	UserId_t userid = params[2];
-	std::vector<RoleId_t> const *roles = nullptr;
-	for (auto &m : guild->GetMembers())
-	{
-		if (m.UserId != userid)
-			continue;
-
-		roles = &m.Roles;
-		break;
-	}
-
+	auto const *member = guild->FindMember(userid);
+	std::vector<RoleId_t> const *roles = member != nullptr ? &member->Roles : nullptr;
 	if (roles == nullptr)
 	{
-		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		if (!guild->RequestMissingMember(userid))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
 		return 0;
 	}
 
@@ -1501,50 +1467,120 @@ AMX_DECLARE_NATIVE(Native::DCC_HasGuildMemberRole)
 	}
 
 	UserId_t userid = params[2];
-	std::vector<RoleId_t> const *roles = nullptr;
-	for (auto &m : guild->GetMembers())
+	auto const *member = guild->FindMember(userid);
+	if (member == nullptr)
+	{
+		if (!guild->RequestMissingMember(userid))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		return 0;
+	}
+
+	cell *dest = nullptr;
+	if (amx_GetAddr(amx, params[4], &dest) != AMX_ERR_NONE || dest == nullptr)
 	{
-		if (m.UserId != userid)
-			continue;
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
+		return 0;
+	}
+
+	RoleId_t roleid = params[3];
+	*dest = guild->MemberHasRole(*member, roleid) ? 1 : 0;
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
+	return 1;
+}
 
-		roles = &m.Roles;
-		break;
+// native DCC_GetGuildMemberStatus(DCC_Guild:guild, DCC_User:user, &DCC_UserPresenceStatus:status);
+AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberStatus)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetGuildMemberStatus", params, "ddr");
+
+	GuildId_t guildid = params[1];
+	Guild_t const &guild = GuildManager::Get()->FindGuild(guildid);
+	if (!guild)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid guild id '{}'", guildid);
+		return 0;
 	}
 
-	if (roles == nullptr)
+	UserId_t userid = params[2];
+	auto const *member = guild->FindMember(userid);
+	auto status = member != nullptr ? member->Status : Guild::Member::PresenceStatus::INVALID;
+
+	if (status == Guild::Member::PresenceStatus::INVALID)
 	{
-		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		if (!guild->RequestMissingMember(userid))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
 		return 0;
 	}
 
 	cell *dest = nullptr;
-	if (amx_GetAddr(amx, params[4], &dest) != AMX_ERR_NONE || dest == nullptr)
+	if (amx_GetAddr(amx, params[3], &dest) != AMX_ERR_NONE || dest == nullptr)
 	{
 		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
 		return 0;
 	}
 
-	RoleId_t roleid = params[3];
-	bool res = false;
-	for (auto &r : *roles)
+	*dest = static_cast<cell>(status);
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
+	return 1;
+}
+
+// native DCC_GetMemberPermissions(DCC_Guild:guild, DCC_User:user, DCC_Channel:channel, &perm_high, &perm_low);
+AMX_DECLARE_NATIVE(Native::DCC_GetMemberPermissions)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetMemberPermissions", params, "dddrr");
+
+	GuildId_t guildid = params[1];
+	Guild_t const &guild = GuildManager::Get()->FindGuild(guildid);
+	if (!guild)
 	{
-		if (r == roleid)
-		{
-			res = true;
-			break;
-		}
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid guild id '{}'", guildid);
+		return 0;
+	}
+
+	UserId_t userid = params[2];
+	if (!guild->HasMember(userid))
+	{
+		if (!guild->RequestMissingMember(userid))
+			Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		return 0;
 	}
 
-	*dest = res ? 1 : 0;
+	ChannelId_t channelid = params[3];
+	unsigned long long int permissions;
+	if (!guild->GetMemberPermissions(userid, channelid, permissions))
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid channel id '{}'", channelid);
+		return 0;
+	}
+
+	cell *dest = nullptr;
+	if (amx_GetAddr(amx, params[4], &dest) != AMX_ERR_NONE || dest == nullptr)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference for 'perm_high'");
+		return 0;
+	}
+
+	*dest = static_cast<cell>((permissions >> 32) & 0xFFFFFFFF);
+
+	dest = nullptr;
+	if (amx_GetAddr(amx, params[5], &dest) != AMX_ERR_NONE || dest == nullptr)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference for 'perm_low'");
+		return 0;
+	}
+
+	*dest = static_cast<cell>(permissions & 0xFFFFFFFF);
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
 	return 1;
 }
 
-// native DCC_GetGuildMemberStatus(DCC_Guild:guild, DCC_User:user, &DCC_UserPresenceStatus:status);
-AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberStatus)
+// native DCC_QueryGuildMembers(DCC_Guild:guild, DCC_User:dest[], max_size = sizeof dest, DCC_Role:role = DCC_INVALID_ROLE, DCC_UserPresenceStatus:status = INVALID, DCC_Channel:voice_channel = DCC_INVALID_CHANNEL, const name_prefix[] = "");
+AMX_DECLARE_NATIVE(Native::DCC_QueryGuildMembers)
 {
-	ScopedDebugInfo dbg_info(amx, "DCC_GetGuildMemberStatus", params, "ddr");
+	ScopedDebugInfo dbg_info(amx, "DCC_QueryGuildMembers", params, "drdddds");
 
 	GuildId_t guildid = params[1];
 	Guild_t const &guild = GuildManager::Get()->FindGuild(guildid);
@@ -1554,36 +1590,129 @@ AMX_DECLARE_NATIVE(Native::DCC_GetGuildMemberStatus)
 		return 0;
 	}
 
-	UserId_t userid = params[2];
-	auto status = Guild::Member::PresenceStatus::INVALID;
-	for (auto &m : guild->GetMembers())
+	cell *dest = nullptr;
+	if (amx_GetAddr(amx, params[2], &dest) != AMX_ERR_NONE || dest == nullptr)
 	{
-		if (m.UserId != userid)
-			continue;
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
+		return 0;
+	}
 
-		status = m.Status;
-		break;
+	cell const max_dest_size = params[3];
+	if (max_dest_size <= 0)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid destination size '{}'", max_dest_size);
+		return 0;
 	}
 
-	if (status == Guild::Member::PresenceStatus::INVALID)
+	auto const status = static_cast<Guild::Member::PresenceStatus>(params[5]);
+	if (status < Guild::Member::PresenceStatus::INVALID || status > Guild::Member::PresenceStatus::OFFLINE)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid presence status '{}'", params[5]);
+		return 0;
+	}
+
+	Guild::MemberFilter filter;
+	filter.Role = params[4];
+	filter.Status = status;
+	filter.VoiceChannel = params[6];
+	filter.NamePrefix = amx_GetCppString(amx, params[7]);
+
+	// the result is kept around to not allocate on every query
+	static std::vector<UserId_t> members;
+	members.clear();
+	guild->QueryMembers(filter, static_cast<size_t>(max_dest_size), members);
+
+	cell const count = static_cast<cell>(members.size());
+	for (cell i = 0; i != count; ++i)
+		dest[i] = members[i];
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", count);
+	return count;
+}
+
+// native DCC_GetGuildOnlineCount(DCC_Guild:guild, &count);
+AMX_DECLARE_NATIVE(Native::DCC_GetGuildOnlineCount)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetGuildOnlineCount", params, "dr");
+
+	GuildId_t guildid = params[1];
+	Guild_t const &guild = GuildManager::Get()->FindGuild(guildid);
+	if (!guild)
 	{
-		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user specified");
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid guild id '{}'", guildid);
 		return 0;
 	}
 
 	cell *dest = nullptr;
-	if (amx_GetAddr(amx, params[3], &dest) != AMX_ERR_NONE || dest == nullptr)
+	if (amx_GetAddr(amx, params[2], &dest) != AMX_ERR_NONE || dest == nullptr)
 	{
 		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
 		return 0;
 	}
 
-	*dest = static_cast<cell>(status);
+	*dest = static_cast<cell>(guild->GetOnlineCount());
 
 	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
 	return 1;
 }
 
+// native DCC_GetVoiceChannelMembers(DCC_Channel:channel, DCC_User:dest[], max_size = sizeof dest);
+AMX_DECLARE_NATIVE(Native::DCC_GetVoiceChannelMembers)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetVoiceChannelMembers", params, "drd");
+
+	ChannelId_t channelid = params[1];
+	Channel_t const &channel = ChannelManager::Get()->FindChannel(channelid);
+	if (!channel)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid channel id '{}'", channelid);
+		return 0;
+	}
+
+	Guild_t const &guild = GuildManager::Get()->FindGuild(channel->GetGuildId());
+	if (!guild)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR,
+			"channel '{}' doesn't belong to a guild", channelid);
+		return 0;
+	}
+
+	cell *dest = nullptr;
+	if (amx_GetAddr(amx, params[2], &dest) != AMX_ERR_NONE || dest == nullptr)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
+		return 0;
+	}
+
+	cell const max_dest_size = params[3];
+	if (max_dest_size <= 0)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid destination size '{}'", max_dest_size);
+		return 0;
+	}
+
+	cell count = 0;
+	auto const *users = guild->GetVoiceChannelMembers(channelid);
+	if (users != nullptr)
+	{
+		if (users->size() > static_cast<size_t>(max_dest_size))
+		{
+			Logger::Get()->LogNative(samplog_LogLevel::WARNING,
+				"destination array is too small (should be at least '{}' cells)", users->size());
+		}
+
+		for (auto const &userid : *users)
+		{
+			if (count == max_dest_size)
+				break;
+			dest[count++] = userid;
+		}
+	}
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", count);
+	return count;
+}
+
 // native DCC_GetGuildChannel(DCC_Guild:guild, offset, &DCC_Channel:channel);
 AMX_DECLARE_NATIVE(Native::DCC_GetGuildChannel)
 {
@@ -1975,6 +2104,128 @@ AMX_DECLARE_NATIVE(Native::DCC_RemoveGuildMemberBan)
 	return 1;
 }
 
+// native DCC_RequestGuildMember(DCC_Guild:guild, const user_id[], const callback[] = "", const format[] = "", {Float, _}:...);
+AMX_DECLARE_NATIVE(Native::DCC_RequestGuildMember)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_RequestGuildMember", params, "dsss");
+
+	GuildId_t guildid = params[1];
+	Guild_t const &guild = GuildManager::Get()->FindGuild(guildid);
+	if (!guild)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid guild id '{}'", guildid);
+		return 0;
+	}
+
+	auto const user_id_str = amx_GetCppString(amx, params[2]);
+	Snowflake_t const user_id(user_id_str);
+	if (!user_id.IsValid())
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid user id '{}'", user_id_str);
+		return 0;
+	}
+
+	auto
+		cb_name = amx_GetCppString(amx, params[3]),
+		cb_format = amx_GetCppString(amx, params[4]);
+
+	pawn_cb::Error cb_error;
+	auto cb = pawn_cb::Callback::Prepare(
+		amx, cb_name.c_str(), cb_format.c_str(), params, 5, cb_error);
+	if (cb_error && cb_error.get() != pawn_cb::Error::Type::EMPTY_NAME)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "could not prepare callback");
+		return 0;
+	}
+
+	if (!guild->RequestMembers({ user_id }, std::move(cb)))
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "can't request guild member");
+		return 0;
+	}
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
+	return 1;
+}
+
+// native DCC_SearchGuildMembers(DCC_Guild:guild, const query[], limit = 100, const callback[] = "", const format[] = "", {Float, _}:...);
+AMX_DECLARE_NATIVE(Native::DCC_SearchGuildMembers)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_SearchGuildMembers", params, "dsdss");
+
+	GuildId_t guildid = params[1];
+	Guild_t const &guild = GuildManager::Get()->FindGuild(guildid);
+	if (!guild)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid guild id '{}'", guildid);
+		return 0;
+	}
+
+	auto query = amx_GetCppString(amx, params[2]);
+	if (query.empty())
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "empty query");
+		return 0;
+	}
+
+	auto limit = params[3];
+	if (limit < 1 || limit > 100)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR,
+			"limit must be between 1 and 100");
+		return 0;
+	}
+
+	auto
+		cb_name = amx_GetCppString(amx, params[4]),
+		cb_format = amx_GetCppString(amx, params[5]);
+
+	pawn_cb::Error cb_error;
+	auto cb = pawn_cb::Callback::Prepare(
+		amx, cb_name.c_str(), cb_format.c_str(), params, 6, cb_error);
+	if (cb_error && cb_error.get() != pawn_cb::Error::Type::EMPTY_NAME)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "could not prepare callback");
+		return 0;
+	}
+
+	if (!guild->SearchMembers(query, static_cast<unsigned int>(limit), std::move(cb)))
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "can't search guild members");
+		return 0;
+	}
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
+	return 1;
+}
+
+// native DCC_GetRequestedMemberCount();
+AMX_DECLARE_NATIVE(Native::DCC_GetRequestedMemberCount)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetRequestedMemberCount", params);
+	return static_cast<cell>(GuildManager::Get()->GetRequestedMembers().size());
+}
+
+// native DCC_User:DCC_GetRequestedMember(index);
+AMX_DECLARE_NATIVE(Native::DCC_GetRequestedMember)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetRequestedMember", params, "d");
+
+	auto const &members = GuildManager::Get()->GetRequestedMembers();
+	auto index = static_cast<unsigned int>(params[1]);
+	if (index >= members.size())
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR,
+			"invalid index '{}', max size is '{}'",
+			index, members.size());
+		return INVALID_USER_ID;
+	}
+
+	cell ret_val = members.at(index);
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '{}'", ret_val);
+	return ret_val;
+}
+
 // native DCC_SetGuildRolePosition(DCC_Guild:guild, DCC_Role:role, position);
 AMX_DECLARE_NATIVE(Native::DCC_SetGuildRolePosition)
 {
@@ -2335,6 +2586,38 @@ AMX_DECLARE_NATIVE(Native::DCC_SetBotActivity)
 	return 1;
 }
 
+// native DCC_GetGatewayLatency(&latency_ms, &median_ms = 0, &p99_ms = 0);
+AMX_DECLARE_NATIVE(Native::DCC_GetGatewayLatency)
+{
+	ScopedDebugInfo dbg_info(amx, "DCC_GetGatewayLatency", params, "rrr");
+
+	unsigned int last_ms, median_ms, p99_ms;
+	if (!Network::Get()->WebSocket().GetLatency(last_ms, median_ms, p99_ms))
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::WARNING, "no heartbeat was acknowledged yet");
+		return 0;
+	}
+
+	cell
+		*last_dest = nullptr,
+		*median_dest = nullptr,
+		*p99_dest = nullptr;
+	if (amx_GetAddr(amx, params[1], &last_dest) != AMX_ERR_NONE || last_dest == nullptr
+		|| amx_GetAddr(amx, params[2], &median_dest) != AMX_ERR_NONE || median_dest == nullptr
+		|| amx_GetAddr(amx, params[3], &p99_dest) != AMX_ERR_NONE || p99_dest == nullptr)
+	{
+		Logger::Get()->LogNative(samplog_LogLevel::ERROR, "invalid reference");
+		return 0;
+	}
+
+	*last_dest = static_cast<cell>(last_ms);
+	*median_dest = static_cast<cell>(median_ms);
+	*p99_dest = static_cast<cell>(p99_ms);
+
+	Logger::Get()->LogNative(samplog_LogLevel::DEBUG, "return value: '1'");
+	return 1;
+}
+
 // native DCC_EscapeMarkdown(const src[], dest[], max_size = sizeof dest);
 AMX_DECLARE_NATIVE(Native::DCC_EscapeMarkdown)
 {
@@ -76,6 +76,10 @@ namespace Native
 	AMX_DECLARE_NATIVE(DCC_GetGuildMemberRoleCount);
 	AMX_DECLARE_NATIVE(DCC_HasGuildMemberRole);
 	AMX_DECLARE_NATIVE(DCC_GetGuildMemberStatus);
+	AMX_DECLARE_NATIVE(DCC_GetMemberPermissions);
+	AMX_DECLARE_NATIVE(DCC_QueryGuildMembers);
+	AMX_DECLARE_NATIVE(DCC_GetGuildOnlineCount);
+	AMX_DECLARE_NATIVE(DCC_GetVoiceChannelMembers);
 	AMX_DECLARE_NATIVE(DCC_GetGuildChannel);
 	AMX_DECLARE_NATIVE(DCC_GetGuildChannelCount);
 	AMX_DECLARE_NATIVE(DCC_GetAllGuilds);
@@ -89,6 +93,10 @@ namespace Native
 	AMX_DECLARE_NATIVE(DCC_RemoveGuildMember);
 	AMX_DECLARE_NATIVE(DCC_CreateGuildMemberBan);
 	AMX_DECLARE_NATIVE(DCC_RemoveGuildMemberBan);
+	AMX_DECLARE_NATIVE(DCC_RequestGuildMember);
+	AMX_DECLARE_NATIVE(DCC_SearchGuildMembers);
+	AMX_DECLARE_NATIVE(DCC_GetRequestedMemberCount);
+	AMX_DECLARE_NATIVE(DCC_GetRequestedMember);
 	AMX_DECLARE_NATIVE(DCC_SetGuildRolePosition);
 	AMX_DECLARE_NATIVE(DCC_SetGuildRoleName);
 	AMX_DECLARE_NATIVE(DCC_SetGuildRolePermissions);
@@ -106,6 +114,7 @@ namespace Native
 	AMX_DECLARE_NATIVE(DCC_GetCreatedPrivateChannel);
 	AMX_DECLARE_NATIVE(DCC_SetBotPresenceStatus);
 	AMX_DECLARE_NATIVE(DCC_SetBotActivity);
+	AMX_DECLARE_NATIVE(DCC_GetGatewayLatency);
 
 	AMX_DECLARE_NATIVE(DCC_EscapeMarkdown);
 
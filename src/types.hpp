@@ -3,35 +3,38 @@
 #include <string>
 #include <memory>
 #include "sdk.hpp"
+#include "Snowflake.hpp"
 
 
-using Snowflake_t = std::string;
+using Snowflake_t = Snowflake;
 
-using Guild_t = std::unique_ptr<class Guild>;
+// entities stored in the SlotMap of their manager are referred to by plain,
+// non-owning pointers
+using Guild_t = class Guild *;
 using GuildId_t = cell;
 const GuildId_t INVALID_GUILD_ID = 0;
 
-using User_t = std::unique_ptr<class User>;
+using User_t = class User *;
 using UserId_t = cell;
 const UserId_t INVALID_USER_ID = 0;
 
-using Channel_t = std::unique_ptr<class Channel>;
+using Channel_t = class Channel *;
 using ChannelId_t = cell;
 const ChannelId_t INVALID_CHANNEL_ID = 0;
 
-using Message_t = std::unique_ptr<class Message>;
+using Message_t = class Message *;
 using MessageId_t = cell;
 const MessageId_t INVALID_MESSAGE_ID = 0;
 
-using Role_t = std::unique_ptr<class Role>;
+using Role_t = class Role *;
 using RoleId_t = cell;
 const RoleId_t INVALID_ROLE_ID = 0;
 
-using Embed_t = std::unique_ptr<class Embed>;
+using Embed_t = class Embed *;
 using EmbedId_t = cell;
 const EmbedId_t INVALID_EMBED_ID = 0;
 
-using Emoji_t = std::unique_ptr<class Emoji>;
+using Emoji_t = class Emoji *;
 using EmojiId_t = cell;
 const EmojiId_t INVALID_EMOJI_ID = 0;
 